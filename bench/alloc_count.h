@@ -0,0 +1,10 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+#include <cstdint>
+
+//number of heap allocations since the start of the program
+//linking alloc_count.cpp replaces malloc/calloc/realloc (glibc) or operator new (elsewhere) with counting versions
+uint64_t allocation_count();
+
+#endif //ALLOC_COUNT_H
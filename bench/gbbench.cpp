@@ -0,0 +1,323 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+#include <sys/resource.h>
+#include "../gb.h"
+#include "../lockstep.h"
+#include "../savestate.h"
+#include "../statestore.h"
+#include "../movie.h"
+#include "alloc_count.h"
+
+//end to end throughput benchmark
+//boots a rom, replays an input recording for a number of frames and prints the result as json
+//usage: gbbench rom.gb [--frames n] [--input file] [--no-render] [--repeats n]
+//                      [--baseline file] [--threshold percent] [--save-baseline file] [--lockstep n] [--store]
+//the input recording is a movie (movie.h) or one byte per frame with the JOYPAD_ mask, frames past its end have
+//no button pressed
+//exit code: 0 ok, 1 error, 2 frames per second regressed more than threshold against the baseline,
+//3 the frame loop allocated heap memory
+//--lockstep n runs n copies through the lockstep engine, cycles, instructions and frames per second
+//are then summed over every lane
+//--store runs the frames once more keeping a snapshot of every frame in a state store (statestore.h)
+//and adds its size and the cost of a snapshot
+
+typedef std::chrono::steady_clock bench_clock;
+
+typedef struct bench_options {
+    const char *rom;
+    const char *input;
+    const char *baseline;
+    const char *save_baseline;
+    uint32_t frames;
+    uint32_t repeats;
+    double threshold;
+    int draw;
+    uint32_t lockstep;
+    int store;
+} bench_options;
+
+typedef struct bench_run {
+    double seconds;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t allocations;
+    uint64_t vector_instructions;
+} bench_run;
+
+uint8_t *recording;
+size_t recording_length;
+
+bench_run run(gameboy *gb, const bench_options *opt) {
+    bench_run res;
+    uint64_t cycles = gb->total_cycles, instructions = gb->total_instructions;
+    uint64_t allocations = allocation_count();
+    auto start = bench_clock::now();
+    for (uint32_t frame = 0; frame < opt->frames; frame++) {
+        set_joypad(gb, frame < recording_length ? recording[frame] : 0);
+        run_frame(gb, opt->draw);
+    }
+    auto end = bench_clock::now();
+    res.allocations = allocation_count() - allocations;
+    res.seconds = std::chrono::duration<double>(end - start).count();
+    res.cycles = gb->total_cycles - cycles;
+    res.instructions = gb->total_instructions - instructions;
+    res.vector_instructions = 0;
+    return res;
+}
+
+bench_run run_lockstep(lockstep *ls, const bench_options *opt) {
+    bench_run res;
+    uint64_t cycles = 0, instructions = 0;
+    for (uint32_t i = 0; i < ls->count; i++) {
+        cycles += ls->lane[i]->total_cycles;
+        instructions += ls->lane[i]->total_instructions;
+    }
+    uint64_t vector_instructions = ls->vector_instructions;
+    uint64_t allocations = allocation_count();
+    auto start = bench_clock::now();
+    for (uint32_t frame = 0; frame < opt->frames; frame++) {
+        for (uint32_t i = 0; i < ls->count; i++)
+            set_joypad(ls->lane[i], frame < recording_length ? recording[frame] : 0);
+        lockstep_run_frame(ls, opt->draw);
+    }
+    auto end = bench_clock::now();
+    res.allocations = allocation_count() - allocations;
+    res.seconds = std::chrono::duration<double>(end - start).count();
+    res.cycles = -cycles;
+    res.instructions = -instructions;
+    for (uint32_t i = 0; i < ls->count; i++) {
+        res.cycles += ls->lane[i]->total_cycles;
+        res.instructions += ls->lane[i]->total_instructions;
+    }
+    res.vector_instructions = ls->vector_instructions - vector_instructions;
+    return res;
+}
+
+typedef struct store_run {
+    double put_us;
+    uint32_t snapshots;
+    uint32_t pages;
+    size_t bytes;
+} store_run;
+
+//every frame goes in the store, the store holds at most one distinct page per page of every snapshot
+int run_store(gameboy *gb, const bench_options *opt, store_run *res) {
+    uint32_t snapshot_pages = (state_size() + STORE_PAGE - 1) / STORE_PAGE;
+    page_store *store = create_page_store(opt->frames * snapshot_pages, NULL);
+    if (store == NULL)
+        return -1;
+    bench_clock::duration put{};
+    for (uint32_t frame = 0; frame < opt->frames; frame++) {
+        set_joypad(gb, frame < recording_length ? recording[frame] : 0);
+        run_frame(gb, opt->draw);
+        auto start = bench_clock::now();
+        store_save(store, gb);
+        put += bench_clock::now() - start;
+    }
+    res->put_us = std::chrono::duration<double, std::micro>(put).count() / opt->frames;
+    res->snapshots = store->live_snapshots;
+    res->pages = store->live_pages;
+    res->bytes = store_bytes(store);
+    destroy_page_store(store);
+    return 0;
+}
+
+//value of a number field in a flat json object, -1 if missing
+double json_number(const char *json, const char *key) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    const char *p = strstr(json, pattern);
+    if (p == NULL)
+        return -1;
+    p = strchr(p + strlen(pattern), ':');
+    if (p == NULL)
+        return -1;
+    return atof(p + 1);
+}
+
+double load_baseline(const char *path) {
+    char json[0x1000];
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "cannot open baseline %s\n", path);
+        return -1;
+    }
+    size_t n = fread(json, 1, sizeof(json) - 1, fp);
+    json[n] = 0;
+    fclose(fp);
+    return json_number(json, "frames_per_second");
+}
+
+int main(int argc, char **argv) {
+    auto process_start = bench_clock::now();
+    bench_options opt = {NULL, NULL, NULL, NULL, 3600, 1, 5.0, 1, 0, 0};
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            opt.frames = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+            opt.input = argv[++i];
+        else if (strcmp(argv[i], "--no-render") == 0)
+            opt.draw = 0;
+        else if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc)
+            opt.repeats = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+            opt.baseline = argv[++i];
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+            opt.threshold = atof(argv[++i]);
+        else if (strcmp(argv[i], "--save-baseline") == 0 && i + 1 < argc)
+            opt.save_baseline = argv[++i];
+        else if (strcmp(argv[i], "--lockstep") == 0 && i + 1 < argc)
+            opt.lockstep = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--store") == 0)
+            opt.store = 1;
+        else if (argv[i][0] != '-' && opt.rom == NULL)
+            opt.rom = argv[i];
+        else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (opt.rom == NULL) {
+        fprintf(stderr, "usage: gbbench rom.gb [--frames n] [--input file] [--no-render] [--repeats n]\n"
+                        "               [--baseline file] [--threshold percent] [--save-baseline file] [--lockstep n] [--store]\n");
+        return 1;
+    }
+    if (opt.repeats < 1)
+        opt.repeats = 1;
+    movie input = {};
+    if (opt.input != NULL && load_movie(&input, opt.input))
+        return 1;
+    recording = input.buttons;
+    recording_length = input.frames;
+
+    //startup is the time until the first instruction can run
+    rom cart;
+    if (load_rom_file(&cart, opt.rom) || check_movie(&input, &cart))
+        return 1;
+    gameboy *gb = NULL;
+    lockstep *ls = NULL;
+    if (opt.lockstep > 0) {
+        if ((ls = create_lockstep(opt.lockstep, &cart)) == NULL)
+            return 1;
+    } else {
+        if ((gb = create_gameboy()) == NULL)
+            return 1;
+        gb->verbose = 0;
+        machine_init(gb, &cart);
+    }
+    double startup_ms = std::chrono::duration<double, std::milli>(bench_clock::now() - process_start).count();
+
+    //median run by frames per second
+    bench_run runs[64];
+    uint32_t n = std::min(opt.repeats, 64u);
+    for (uint32_t i = 0; i < n; i++) {
+        if (ls != NULL) {
+            if (i > 0) {
+                destroy_lockstep(ls);
+                if ((ls = create_lockstep(opt.lockstep, &cart)) == NULL)
+                    return 1;
+            }
+            runs[i] = run_lockstep(ls, &opt);
+            continue;
+        }
+        if (i > 0)
+            machine_init(gb, &cart);
+        runs[i] = run(gb, &opt);
+    }
+    std::sort(runs, runs + n, [](const bench_run &a, const bench_run &b) { return a.seconds < b.seconds; });
+    bench_run res = runs[n / 2];
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    uint32_t lanes = ls != NULL ? opt.lockstep : 1;
+    double fps = (double) opt.frames * lanes / res.seconds;
+
+    char json[0x1000];
+    int len = snprintf(json, sizeof(json),
+                       "{\n"
+                       "  \"rom\": \"%s\",\n"
+                       "  \"frames\": %u,\n"
+                       "  \"render\": %s,\n"
+                       "  \"repeats\": %u,\n"
+                       "  \"seconds\": %.6f,\n"
+                       "  \"cycles\": %llu,\n"
+                       "  \"instructions\": %llu,\n"
+                       "  \"emulated_mhz\": %.3f,\n"
+                       "  \"frames_per_second\": %.3f,\n"
+                       "  \"instructions_per_second\": %.0f,\n"
+                       "  \"peak_rss_kb\": %ld,\n"
+                       "  \"startup_ms\": %.3f,\n"
+                       "  \"allocations_per_frame\": %.3f",
+                       opt.rom, opt.frames, opt.draw ? "true" : "false", n, res.seconds,
+                       (unsigned long long) res.cycles, (unsigned long long) res.instructions,
+                       res.cycles / res.seconds / 1e6, fps, res.instructions / res.seconds,
+                       usage.ru_maxrss, startup_ms, (double) res.allocations / opt.frames);
+
+    int status = 0;
+    if (res.allocations > 0)
+        status = 3;
+    if (opt.baseline != NULL) {
+        double baseline = load_baseline(opt.baseline);
+        if (baseline <= 0) {
+            fprintf(stderr, "no frames_per_second in baseline %s\n", opt.baseline);
+            return 1;
+        }
+        double change = (fps - baseline) * 100 / baseline;
+        int regressed = change < -opt.threshold;
+        len += snprintf(json + len, sizeof(json) - len,
+                        ",\n"
+                        "  \"baseline_frames_per_second\": %.3f,\n"
+                        "  \"change_percent\": %.2f,\n"
+                        "  \"threshold_percent\": %.2f,\n"
+                        "  \"regression\": %s",
+                        baseline, change, opt.threshold, regressed ? "true" : "false");
+        if (regressed)
+            status = 2;
+    }
+    if (ls != NULL)
+        len += snprintf(json + len, sizeof(json) - len,
+                        ",\n"
+                        "  \"lockstep_lanes\": %u,\n"
+                        "  \"vector_fraction\": %.4f",
+                        lanes, res.instructions > 0 ? (double) res.vector_instructions / res.instructions : 0);
+    store_run store;
+    if (opt.store && gb != NULL) {
+        machine_init(gb, &cart);
+        if (run_store(gb, &opt, &store)) {
+            fprintf(stderr, "cannot create the state store\n");
+            return 1;
+        }
+        len += snprintf(json + len, sizeof(json) - len,
+                        ",\n"
+                        "  \"store_snapshots\": %u,\n"
+                        "  \"store_pages\": %u,\n"
+                        "  \"store_bytes\": %llu,\n"
+                        "  \"store_bytes_per_snapshot\": %.1f,\n"
+                        "  \"store_put_us\": %.3f",
+                        store.snapshots, store.pages, (unsigned long long) store.bytes,
+                        store.snapshots > 0 ? (double) store.bytes / store.snapshots : 0, store.put_us);
+    }
+    len += snprintf(json + len, sizeof(json) - len, "\n}\n");
+    fputs(json, stdout);
+
+    if (opt.save_baseline != NULL) {
+        FILE *fp = fopen(opt.save_baseline, "w");
+        if (fp == NULL) {
+            fprintf(stderr, "cannot write baseline %s\n", opt.save_baseline);
+            return 1;
+        }
+        fputs(json, fp);
+        fclose(fp);
+    }
+    if (ls != NULL)
+        destroy_lockstep(ls);
+    else
+        destroy_gameboy(gb);
+    free_rom(&cart);
+    free(recording);
+    return status;
+}
@@ -0,0 +1,389 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include "../gb.h"
+
+//microbenchmarks for the core hot paths
+//every benchmark runs on a synthetic rom and vram built from a fixed seed so runs are comparable,
+//each one is repeated to report median/min/stddev in ns per operation
+//usage: microbench [filter] [--repeats n] [--ms target_ms]
+
+volatile uint32_t sink;
+
+uint32_t seed = 0x12345678;
+uint8_t next_random() {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+//program area for cpu benchmarks, in rom bank 0 so it is read from mem
+#define PROGRAM 0x1000
+int program_length;//instructions
+int program_bytes;
+
+gameboy *gb;
+rom cart;
+
+void synthetic_init() {
+    seed = 0x12345678;
+    if (cart.buffer == NULL) {
+        cart.size = ROM_MIN_SIZE;
+        cart.buffer = (uint8_t *) calloc(cart.size, 1);
+    }
+    for (int i = 0; i < 0x8000; i++)
+        cart.buffer[i] = next_random();
+    machine_init(gb, &cart);
+    gb->offset = 0x4000;
+    for (int i = VRAM; i < ERAM; i++)
+        gb->memory[i] = next_random();
+    for (int i = 0; i < 0xA0; i++)
+        gb->memory[OAM + i] = next_random();
+    //lcd on, sprites on, window on
+    gb->memory[LCDC] = 0xF3;
+    latch_ppu(gb);
+}
+
+//cpu registers used by the cpu benchmarks, (HL) points to wram
+void cpu_reset() {
+    registers &reg = gb->reg;
+    reg_init(gb);
+    reg.HL = WRAM;
+    reg.SP = 0xDFF0;
+    reg.PC = PROGRAM;
+}
+
+//append an instruction to the benchmark program
+void emit(int n, uint8_t b0, uint8_t b1 = 0, uint8_t b2 = 0) {
+    uint8_t bytes[3] = {b0, b1, b2};
+    memcpy(&gb->memory[PROGRAM + program_bytes], bytes, n);
+    program_bytes += n;
+    program_length++;
+}
+
+void program_begin() {
+    program_length = 0;
+    program_bytes = 0;
+}
+
+typedef void (*bench_fn)(uint32_t iterations);
+
+//memory benchmarks, one operation is one access
+uint16_t region_start, region_size;
+
+void bench_read(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+        sum += read_memory(gb, region_start + ((i * 97) & (region_size - 1)));
+    sink = sum;
+}
+
+void bench_read16(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+        sum += read_memory16(gb, region_start + ((i * 97) & (region_size - 2)));
+    sink = sum;
+}
+
+void bench_write(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++)
+        write_memory(gb, region_start + ((i * 97) & (region_size - 1)), i);
+}
+
+//cpu benchmarks, one operation is one instruction
+void bench_program(uint32_t iterations) {
+    registers &reg = gb->reg;
+    cpu_reset();
+    int left = program_length;
+    for (uint32_t i = 0; i < iterations; i++) {
+        cpu_step(gb, read_memory(gb, reg.PC));
+        if (--left == 0) {
+            reg.PC = PROGRAM;
+            reg.HL = WRAM;
+            left = program_length;
+        }
+    }
+    sink = reg.AF + reg.BC + reg.DE;
+}
+
+void program_alu() {
+    program_begin();
+    //ADD ADC SUB SBC AND XOR OR CP on every register and (HL)
+    for (int op = 0x80; op <= 0xBF; op++)
+        emit(1, op);
+    //INC DEC
+    for (int op = 0x04; op <= 0x3D; op += 8) {
+        if (op == 0x34)
+            continue;
+        emit(1, op);
+        emit(1, op + 1);
+    }
+}
+
+void program_loads() {
+    program_begin();
+    //LD (HL),r first, LD H,r and LD L,r move HL out of wram for the rest of the pass
+    for (int op = 0x70; op <= 0x77; op++) {
+        if (op != 0x76)
+            emit(1, op);
+    }
+    //LD r,r and LD r,(HL)
+    for (int op = 0x40; op <= 0x7F; op++) {
+        if (op < 0x70 || op > 0x77)
+            emit(1, op);
+    }
+    //LD r,d8
+    for (int op = 0x06; op <= 0x3E; op += 8) {
+        if (op != 0x36)
+            emit(2, op, 0x5A);
+    }
+}
+
+void program_cb() {
+    program_begin();
+    //BIT RES SET on every register and (HL)
+    //RES and SET on H and L are left out, they would move (HL) writes onto the mbc registers
+    for (int op = 0x40; op <= 0xFF; op++) {
+        if (op >= 0x80 && ((op & 0x07) == 4 || (op & 0x07) == 5))
+            continue;
+        emit(2, 0xCB, op);
+    }
+}
+
+void program_control() {
+    program_begin();
+    uint16_t subroutine = PROGRAM + 0x400;
+    for (int i = 0; i < 16; i++) {
+        uint16_t next;
+        //CALL nn to a RET
+        emit(3, 0xCD, subroutine & 0xFF, subroutine >> 8);
+        //JP nn to the next instruction
+        next = PROGRAM + program_bytes + 3;
+        emit(3, 0xC3, next & 0xFF, next >> 8);
+        //JR +0
+        emit(2, 0x18, 0x00);
+        //JR NZ +0, JR Z +0, one of them is taken
+        emit(2, 0x20, 0x00);
+        emit(2, 0x28, 0x00);
+        //JP NZ nn
+        next = PROGRAM + program_bytes + 3;
+        emit(3, 0xC2, next & 0xFF, next >> 8);
+    }
+    gb->memory[subroutine] = 0xC9;
+    //the RET runs once per CALL
+    program_length += 16;
+}
+
+//ppu benchmarks
+void bench_draw_pixel(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+        sum += draw_pixel(gb, i >> 8, i);
+    sink = sum;
+}
+
+void bench_draw_window_pixel(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+        sum += draw_window_pixel(gb, i >> 8, i);
+    sink = sum;
+}
+
+void bench_draw_sprite(uint32_t iterations) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+        sum += draw_sprite(gb, i & 7, (i >> 3) & 15, i >> 7, 0, 15, (i >> 4) & 1, (i >> 5) & 1);
+    sink = sum;
+}
+
+void bench_render(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++)
+        render(gb);
+    sink = gb->framebuffer[128][128];
+}
+
+//episode resets: a power on, and a reset to a frozen snapshot with nothing or a few pages written in between,
+//the dirty one includes the copies of the written pages that the first writes make
+gameboy *snapshot;
+
+void bench_power_on(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++)
+        machine_init(gb, &cart);
+    sink = gb->memory[0x100];
+}
+
+void bench_reset_clean(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++)
+        reset_gameboy(snapshot, gb);
+    sink = gb->reg.PC;
+}
+
+void bench_reset_dirty(uint32_t iterations) {
+    for (uint32_t i = 0; i < iterations; i++) {
+        //wram, both vram pages and the page of io and hram
+        write_memory(gb, WRAM + (i & 0xFF), i);
+        write_memory(gb, VRAM + (i & 0xFF), i);
+        write_memory(gb, VRAM + 0x1000 + (i & 0xFF), i);
+        write_memory(gb, HRAM + (i & 0x3F), i);
+        reset_gameboy(snapshot, gb);
+    }
+    sink = gb->reg.PC;
+}
+
+typedef struct bench_result {
+    double median;
+    double min;
+    double max;
+    double mean;
+    double stddev;
+    uint32_t iterations;
+} bench_result;
+
+int repeats = 15;
+double target_ms = 20;
+const char *filter = NULL;
+
+double run_once(bench_fn fn, uint32_t iterations) {
+    auto start = std::chrono::steady_clock::now();
+    fn(iterations);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+//pick an iteration count that takes about target_ms, then time repeats runs of it
+bench_result run_bench(bench_fn fn) {
+    bench_result res;
+    uint32_t iterations = 1;
+    run_once(fn, iterations);
+    while (iterations < (1u << 30)) {
+        double ns = run_once(fn, iterations);
+        if (ns >= target_ms * 1e6 / 4)
+            break;
+        iterations *= 2;
+    }
+    iterations *= 4;
+    double samples[256];
+    int n = std::min(repeats, 256);
+    for (int i = 0; i < n; i++)
+        samples[i] = run_once(fn, iterations) / iterations;
+    std::sort(samples, samples + n);
+    res.iterations = iterations;
+    res.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    res.min = samples[0];
+    res.max = samples[n - 1];
+    res.mean = 0;
+    for (int i = 0; i < n; i++)
+        res.mean += samples[i];
+    res.mean /= n;
+    res.stddev = 0;
+    for (int i = 0; i < n; i++)
+        res.stddev += (samples[i] - res.mean) * (samples[i] - res.mean);
+    res.stddev = n > 1 ? sqrt(res.stddev / (n - 1)) : 0;
+    return res;
+}
+
+void report(const char *name, bench_fn fn) {
+    if (filter != NULL && strstr(name, filter) == NULL)
+        return;
+    bench_result res = run_bench(fn);
+    printf("%-28s %10.2f %10.2f %10.2f %9.2f%% %12u\n", name, res.median, res.min, res.max,
+           res.median > 0 ? res.stddev * 100 / res.median : 0, res.iterations);
+    fflush(stdout);
+}
+
+typedef struct region {
+    const char *name;
+    uint16_t start;
+    uint16_t size;
+} region;
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc)
+            repeats = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--ms") == 0 && i + 1 < argc)
+            target_ms = atof(argv[++i]);
+        else
+            filter = argv[i];
+    }
+    if (repeats < 1)
+        repeats = 1;
+    gb = create_gameboy();
+    if (gb == NULL)
+        return 1;
+    gb->verbose = 0;
+    synthetic_init();
+    printf("%-28s %10s %10s %10s %10s %12s\n", "benchmark", "median ns", "min ns", "max ns", "stddev", "ops/repeat");
+
+    //writes to rom only touch the mbc registers below 0x2000, bank switching prints
+    region read_regions[] = {{"rom0",  ROM0, 0x4000},
+                             {"rom1",  ROM1, 0x4000},
+                             {"vram",  VRAM, 0x2000},
+                             {"eram",  ERAM, 0x2000},
+                             {"wram",  WRAM, 0x1000},
+                             {"oam",   OAM,  0x80},
+                             {"io",    0xFF00, 0x80},
+                             {"hram",  HRAM, 0x40}};
+    region write_regions[] = {{"rom_mbc", ROM0, 0x1000},
+                              {"vram",    VRAM, 0x2000},
+                              {"eram",    ERAM, 0x2000},
+                              {"wram",    WRAM, 0x1000},
+                              {"oam",     OAM,  0x80},
+                              {"io",      0xFF00, 0x80},
+                              {"hram",    HRAM, 0x40}};
+    char name[64];
+    for (region &rg : read_regions) {
+        region_start = rg.start;
+        region_size = rg.size;
+        snprintf(name, sizeof(name), "read_memory/%s", rg.name);
+        report(name, bench_read);
+    }
+    for (region &rg : read_regions) {
+        region_start = rg.start;
+        region_size = rg.size;
+        snprintf(name, sizeof(name), "read_memory16/%s", rg.name);
+        report(name, bench_read16);
+    }
+    for (region &rg : write_regions) {
+        region_start = rg.start;
+        region_size = rg.size;
+        snprintf(name, sizeof(name), "write_memory/%s", rg.name);
+        report(name, bench_write);
+    }
+    synthetic_init();
+
+    program_alu();
+    report("cpu_step/alu", bench_program);
+    program_loads();
+    report("cpu_step/loads", bench_program);
+    program_cb();
+    report("cpu_step/cb_bit", bench_program);
+    program_control();
+    report("cpu_step/control_flow", bench_program);
+
+    synthetic_init();
+    report("ppu/draw_pixel", bench_draw_pixel);
+    report("ppu/draw_window_pixel", bench_draw_window_pixel);
+    report("ppu/draw_sprite", bench_draw_sprite);
+    report("ppu/render", bench_render);
+
+    report("reset/power_on", bench_power_on);
+    snapshot = create_gameboy();
+    if (snapshot != NULL) {
+        snapshot->verbose = 0;
+        synthetic_init();
+        fork_gameboy(gb, snapshot);
+        if (freeze_gameboy(snapshot) == 0) {
+            reset_gameboy(snapshot, gb);
+            report("reset/snapshot_clean", bench_reset_clean);
+            report("reset/snapshot_dirty", bench_reset_dirty);
+        }
+        destroy_gameboy(snapshot);
+    }
+    destroy_gameboy(gb);
+    free_rom(&cart);
+    return 0;
+}
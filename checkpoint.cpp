@@ -0,0 +1,171 @@
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+#include <new>
+#include <chrono>
+#include <filesystem>
+#include "checkpoint.h"
+#include "savestate.h"
+
+typedef std::chrono::steady_clock checkpoint_clock;
+
+//a whole file or nothing: written to temp, synced, renamed over path and the directory synced
+static int write_atomically(const char *path, const char *temp, const uint8_t *data, size_t size) {
+#ifndef _WIN32
+    int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = write(fd, data + done, size - done);
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    int err = done != size || fsync(fd) != 0;
+    err |= close(fd) != 0;
+#else
+    FILE *fp = fopen(temp, "wb");
+    if (fp == NULL)
+        return -1;
+    int err = fwrite(data, 1, size, fp) != size;
+    err |= fclose(fp) != 0;
+#endif
+    std::error_code e;
+    if (!err)
+        std::filesystem::rename(temp, path, e);
+    if (err || e)
+        return -1;
+#ifndef _WIN32
+    //the rename is only durable once the directory holding it is synced too
+    std::filesystem::path directory = std::filesystem::path(path).parent_path();
+    int dir = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir < 0)
+        return -1;
+    err = fsync(dir) != 0;
+    err |= close(dir) != 0;
+#endif
+    return err ? -1 : 0;
+}
+
+static void write_checkpoints(checkpointer *c) {
+#ifdef __linux__
+    //lowest priority for this thread alone, waking it does not take the core from the emulation
+    setpriority(PRIO_PROCESS, 0, 19);
+#endif
+    std::unique_lock<std::mutex> guard(c->lock);
+    while (true) {
+        c->wake.wait(guard, [c] { return c->pending >= 0 || c->stop; });
+        if (c->pending < 0)
+            return;
+        c->writing = c->pending;
+        c->pending = -1;
+        guard.unlock();
+        auto start = checkpoint_clock::now();
+        int err = write_atomically(c->path, c->temp, c->buffer[c->writing], c->size);
+        double seconds = std::chrono::duration<double>(checkpoint_clock::now() - start).count();
+        guard.lock();
+        c->writing = -1;
+        c->write_seconds += seconds;
+        if (err)
+            c->failed++;
+        else
+            c->written++;
+    }
+}
+
+checkpointer *create_checkpointer(const char *path) {
+    checkpointer *c = new (std::nothrow) checkpointer();
+    if (c == NULL)
+        return NULL;
+    c->path = strdup(path);
+    c->temp = (char *) malloc(strlen(path) + 5);
+    c->size = state_size() + sizeof(checkpoint_trailer);
+    int err = c->path == NULL || c->temp == NULL;
+    for (int i = 0; i < CHECKPOINT_BUFFERS; i++)
+        err |= (c->buffer[i] = (uint8_t *) malloc(c->size)) == NULL;
+    if (err) {
+        free(c->path);
+        free(c->temp);
+        for (int i = 0; i < CHECKPOINT_BUFFERS; i++)
+            free(c->buffer[i]);
+        delete c;
+        return NULL;
+    }
+    sprintf(c->temp, "%s.tmp", path);
+    c->pending = -1;
+    c->writing = -1;
+    c->writer = std::thread(write_checkpoints, c);
+    return c;
+}
+
+void stop_checkpointer(checkpointer *c) {
+    if (!c->writer.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> guard(c->lock);
+        c->stop = 1;
+    }
+    c->wake.notify_one();
+    c->writer.join();
+}
+
+void destroy_checkpointer(checkpointer *c) {
+    if (c == NULL)
+        return;
+    stop_checkpointer(c);
+    free(c->path);
+    free(c->temp);
+    for (int i = 0; i < CHECKPOINT_BUFFERS; i++)
+        free(c->buffer[i]);
+    delete c;
+}
+
+void take_checkpoint(checkpointer *c, gameboy *gb, uint64_t frame) {
+    //the buffer that is neither waiting nor being written, only this thread fills buffers
+    int free_buffer;
+    {
+        std::lock_guard<std::mutex> guard(c->lock);
+        free_buffer = 0;
+        while (free_buffer == c->pending || free_buffer == c->writing)
+            free_buffer++;
+    }
+    uint8_t *out = c->buffer[free_buffer];
+    save_state(gb, out);
+    checkpoint_trailer trailer = {CHECKPOINT_MAGIC, frame};
+    memcpy(out + state_size(), &trailer, sizeof(trailer));
+    {
+        std::lock_guard<std::mutex> guard(c->lock);
+        if (c->pending >= 0)
+            c->skipped++;
+        c->pending = free_buffer;
+    }
+    c->wake.notify_one();
+    c->taken++;
+}
+
+int resume_checkpoint(gameboy *gb, const char *path, uint64_t *frame) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return 1;
+    size_t size = state_size() + sizeof(checkpoint_trailer);
+    uint8_t *data = (uint8_t *) malloc(size);
+    int err = data == NULL || fread(data, 1, size, fp) != size;
+    fclose(fp);
+    checkpoint_trailer trailer;
+    if (!err) {
+        memcpy(&trailer, data + state_size(), sizeof(trailer));
+        err = trailer.magic != CHECKPOINT_MAGIC || load_state(gb, data, state_size()) != 0;
+    }
+    free(data);
+    if (err) {
+        printf("bad checkpoint %s\n", path);
+        return -1;
+    }
+    //it was taken before the lcd update that ends every frame
+    lcd_update(gb);
+    *frame = trailer.frame;
+    return 0;
+}
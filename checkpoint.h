@@ -0,0 +1,59 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "gb.h"
+
+//periodic checkpoints of a long run
+//the emulation thread only saves the state into a free buffer and hands it over, a writer thread writes it to a
+//temporary file, syncs it, renames it over the checkpoint and syncs the directory, so the file is always a whole
+//checkpoint and the rename survives a power loss
+//there are three buffers, one written, one waiting and one being filled, a checkpoint taken while another is
+//still waiting replaces it, the emulation thread never waits for the disk
+//a checkpoint file is a savestate (savestate.h) followed by a trailer, so it also loads as a plain state
+
+#define CHECKPOINT_MAGIC 0x544E494F504B4843ull //"CHKPOINT" little endian
+#define CHECKPOINT_BUFFERS 3
+
+typedef struct checkpoint_trailer {
+    uint64_t magic;
+    //frames run when it was taken
+    uint64_t frame;
+} checkpoint_trailer;
+
+typedef struct checkpointer {
+    char *path;
+    char *temp;
+    size_t size;
+    uint8_t *buffer[CHECKPOINT_BUFFERS];
+    std::thread writer;
+    std::mutex lock;
+    std::condition_variable wake;
+    //buffer waiting for the writer and buffer being written, -1 for none
+    int pending;
+    int writing;
+    int stop;
+    //counted on the emulation thread
+    uint64_t taken;
+    //replaced while they were waiting
+    uint64_t skipped;
+    //counted on the writer thread, under the lock
+    uint64_t written;
+    uint64_t failed;
+    double write_seconds;
+} checkpointer;
+
+//checkpoints to path, NULL on error
+checkpointer *create_checkpointer(const char *path);
+//write the checkpoint still waiting and stop the writer, the counts are final after it
+void stop_checkpointer(checkpointer *c);
+void destroy_checkpointer(checkpointer *c);
+//hand the state of gb after frame frames to the writer, called right after end_frame
+void take_checkpoint(checkpointer *c, gameboy *gb, uint64_t frame);
+//load the checkpoint at path into gb and give the frame it was taken at, gb is then where the input of that frame
+//is set, 0 on success, 1 if there is no checkpoint, -1 if it is broken or from another rom
+int resume_checkpoint(gameboy *gb, const char *path, uint64_t *frame);
+
+#endif
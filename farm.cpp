@@ -0,0 +1,533 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include "gb.h"
+#include "statehash.h"
+#include "movie.h"
+
+//batch farm runner, no sdl
+//usage: gbfarm manifest.txt [-o results.jsonl] [--threads n | --processes n] [--pin] [--render]
+//                           [--max-cycles n] [--max-seconds s] [--hang-frames n] [--check-determinism]
+//the manifest has one job per line: rom input frames, input is a movie (movie.h) or a raw input file, - for no
+//input, # starts a comment
+//jobs run on a work stealing pool, every worker reuses one instance and maps the rom of each job,
+//one json line per job is written to the results as soon as the job ends, in completion order
+//a job ends with status ok, hang, timeout (--max-seconds), cycles (--max-cycles), error or crash
+//--processes runs the workers as forked processes so a crashing rom only takes its own job down,
+//jobs are claimed from a queue in shared memory and results are written back there, the
+//supervisor streams them out and respawns workers that died
+//--check-determinism runs every job twice side by side from the same inputs and compares the state hashes
+//(statehash.h) after every frame, the first frame where they differ ends the job with status diverged and
+//the first differing byte of the savestates
+
+typedef std::chrono::steady_clock farm_clock;
+
+//pc range of a frame that counts as stuck, a jr to itself or a short polling loop
+#define HANG_SPAN 0x10
+
+typedef struct farm_job {
+    char *rom;
+    char *input;
+    uint32_t frames;
+} farm_job;
+
+typedef struct farm_options {
+    const char *manifest;
+    const char *output;
+    uint32_t threads;
+    uint32_t processes;
+    int pin;
+    int draw;
+    uint64_t max_cycles;
+    double max_seconds;
+    uint32_t hang_frames;
+    int check_determinism;
+} farm_options;
+
+enum job_status {JOB_OK, JOB_HANG, JOB_TIMEOUT, JOB_CYCLES, JOB_ERROR, JOB_CRASH, JOB_DIVERGED, JOB_STATUS_COUNT};
+const char *status_names[JOB_STATUS_COUNT] = {"ok", "hang", "timeout", "cycles", "error", "crash", "diverged"};
+
+typedef struct job_result {
+    int status;
+    uint32_t frames;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint16_t pc;
+    uint64_t memory_hash;
+    uint64_t framebuffer_hash;
+    double startup_us;
+    double seconds;
+    //where the twin of a diverged job first differs, "section offset"
+    char diverged_at[16];
+} job_result;
+
+//job queue of one worker, the owner pops from the back and thieves take from the front
+typedef struct alignas(64) work_queue {
+    std::mutex lock;
+    std::deque<uint32_t> jobs;
+} work_queue;
+
+farm_options opt = {NULL, NULL, 0, 0, 0, 0, 0, 0, 600, 0};
+std::vector<farm_job> jobs;
+work_queue *queues;
+std::atomic<uint32_t> jobs_done;
+std::atomic<uint64_t> frames_done;
+std::atomic<uint32_t> status_count[JOB_STATUS_COUNT];
+
+FILE *results;
+std::mutex results_lock;
+
+uint64_t fnv1a(const uint8_t *data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+//read the manifest, returns the number of jobs or -1
+int load_manifest(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "cannot open manifest %s\n", path);
+        return -1;
+    }
+    char line[0x1000];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line_number++;
+        char rom_path[0x800], input_path[0x800];
+        unsigned frames;
+        char *p = line;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == 0)
+            continue;
+        if (sscanf(p, "%2047s %2047s %u", rom_path, input_path, &frames) != 3) {
+            fprintf(stderr, "%s:%d: expected rom input frames\n", path, line_number);
+            fclose(fp);
+            return -1;
+        }
+        farm_job job;
+        job.rom = strdup(rom_path);
+        job.input = strcmp(input_path, "-") == 0 ? NULL : strdup(input_path);
+        job.frames = frames;
+        jobs.push_back(job);
+    }
+    fclose(fp);
+    return jobs.size();
+}
+
+//own queue first, then steal from the others starting after this worker
+int next_job(uint32_t worker, uint32_t *job) {
+    {
+        std::lock_guard<std::mutex> guard(queues[worker].lock);
+        if (!queues[worker].jobs.empty()) {
+            *job = queues[worker].jobs.back();
+            queues[worker].jobs.pop_back();
+            return 1;
+        }
+    }
+    for (uint32_t i = 1; i < opt.threads; i++) {
+        work_queue &victim = queues[(worker + i) % opt.threads];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.jobs.empty()) {
+            *job = victim.jobs.front();
+            victim.jobs.pop_front();
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//twin is NULL unless determinism is checked, it then runs the same frames as gb
+job_result run_job(gameboy *gb, gameboy *twin, const farm_job *job) {
+    job_result res;
+    memset(&res, 0, sizeof(res));
+    auto start = farm_clock::now();
+    rom cart;
+    movie input = {};
+    if (map_rom_file(&cart, job->rom)) {
+        res.status = JOB_ERROR;
+        return res;
+    }
+    if (job->input != NULL && (load_movie(&input, job->input) || check_movie(&input, &cart))) {
+        free_movie(&input);
+        free_rom(&cart);
+        res.status = JOB_ERROR;
+        return res;
+    }
+    machine_init(gb, &cart);
+    gb->verbose = 0;
+    if (twin != NULL) {
+        machine_init(twin, &cart);
+        twin->verbose = 0;
+    }
+    input_source source = movie_input(&input);
+    auto started = farm_clock::now();
+    res.startup_us = std::chrono::duration<double, std::micro>(started - start).count();
+
+    //watchdog, checked once per frame: a frame always ends because the cycle counter only goes down
+    uint32_t stuck_frames = 0;
+    res.status = JOB_OK;
+    while (res.frames < job->frames) {
+        uint16_t low = gb->reg.PC, high = gb->reg.PC;
+        set_joypad(gb, source.poll(&source, res.frames));
+        while (!step_instruction(gb)) {
+            lcd_update(gb);
+            if (gb->reg.PC < low)
+                low = gb->reg.PC;
+            if (gb->reg.PC > high)
+                high = gb->reg.PC;
+        }
+        end_frame(gb, opt.draw && res.frames + 1 == job->frames);
+        lcd_update(gb);
+        res.frames++;
+        if (twin != NULL) {
+            set_joypad(twin, source.poll(&source, res.frames - 1));
+            run_frame(twin, 0);
+            if (state_hash(gb) != state_hash(twin)) {
+                state_difference(gb, twin, res.diverged_at, sizeof(res.diverged_at));
+                res.status = JOB_DIVERGED;
+                break;
+            }
+        }
+        stuck_frames = high - low < HANG_SPAN ? stuck_frames + 1 : 0;
+        if (opt.hang_frames != 0 && stuck_frames >= opt.hang_frames) {
+            res.status = JOB_HANG;
+            break;
+        }
+        if (opt.max_cycles != 0 && gb->total_cycles >= opt.max_cycles) {
+            res.status = JOB_CYCLES;
+            break;
+        }
+        if (opt.max_seconds > 0 &&
+            std::chrono::duration<double>(farm_clock::now() - started).count() >= opt.max_seconds) {
+            res.status = JOB_TIMEOUT;
+            break;
+        }
+    }
+    res.seconds = std::chrono::duration<double>(farm_clock::now() - started).count();
+    res.cycles = gb->total_cycles;
+    res.instructions = gb->total_instructions;
+    res.pc = gb->reg.PC;
+    res.memory_hash = fnv1a(gb->memory, sizeof(gb->memory));
+    if (opt.draw)
+        res.framebuffer_hash = fnv1a(&gb->framebuffer[0][0], sizeof(gb->framebuffer));
+    free_movie(&input);
+    free_rom(&cart);
+    return res;
+}
+
+//s as the inside of a json string, quotes, backslashes and control characters escaped, cut short to fit size
+void json_escape(char *out, size_t size, const char *s) {
+    size_t len = 0;
+    for (; *s != 0; s++) {
+        unsigned char c = *s;
+        char escaped[8];
+        if (c == '"' || c == '\\')
+            snprintf(escaped, sizeof(escaped), "\\%c", c);
+        else if (c < 0x20)
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        else
+            snprintf(escaped, sizeof(escaped), "%c", c);
+        size_t n = strlen(escaped);
+        if (len + n >= size)
+            break;
+        memcpy(out + len, escaped, n);
+        len += n;
+    }
+    out[len] = 0;
+}
+
+void write_result(uint32_t index, const farm_job *job, const job_result *res) {
+    char rom_path[0x1000], input_path[0x1000];
+    json_escape(rom_path, sizeof(rom_path), job->rom);
+    json_escape(input_path, sizeof(input_path), job->input != NULL ? job->input : "-");
+    char line[0x2400];
+    int len = snprintf(line, sizeof(line),
+                       "{\"job\": %u, \"rom\": \"%s\", \"input\": \"%s\", \"status\": \"%s\", \"frames\": %u, "
+                       "\"cycles\": %llu, \"instructions\": %llu, \"pc\": \"%04X\", \"memory_hash\": \"%016llx\"",
+                       index, rom_path, input_path, status_names[res->status],
+                       res->frames, (unsigned long long) res->cycles, (unsigned long long) res->instructions,
+                       res->pc, (unsigned long long) res->memory_hash);
+    if (opt.draw)
+        len += snprintf(line + len, sizeof(line) - len, ", \"framebuffer_hash\": \"%016llx\"",
+                        (unsigned long long) res->framebuffer_hash);
+    if (res->status == JOB_DIVERGED)
+        len += snprintf(line + len, sizeof(line) - len, ", \"diverged_frame\": %u, \"diverged_at\": \"%s\"",
+                        res->frames, res->diverged_at);
+    snprintf(line + len, sizeof(line) - len, ", \"startup_us\": %.1f, \"seconds\": %.6f}\n",
+             res->startup_us, res->seconds);
+    std::lock_guard<std::mutex> guard(results_lock);
+    fputs(line, results);
+    fflush(results);
+}
+
+//shared between the supervisor and the worker processes, mapped before the fork
+//a job slot goes pending -> running -> done, the supervisor owns it again once it is done
+//running holds the worker in its high bits, so a job is claimed and its worker published by one compare exchange
+//and a worker that dies can never leave a job claimed by nobody
+enum slot_state {SLOT_PENDING, SLOT_RUNNING, SLOT_DONE, SLOT_WRITTEN};
+#define SLOT_RUNNING_BY(worker) (SLOT_RUNNING | ((worker) + 1) << 8)
+#define FARM_MAX_PROCESSES 256
+
+typedef struct shared_farm {
+    //first job that may still be pending, every job before it is claimed
+    alignas(64) std::atomic<uint32_t> next_job;
+} shared_farm;
+
+typedef struct alignas(64) job_slot {
+    std::atomic<uint32_t> state;
+    job_result result;
+} job_slot;
+
+shared_farm *shared;
+job_slot *slots;
+
+void pin_thread(uint32_t cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % CPU_SETSIZE, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        fprintf(stderr, "cannot pin worker to cpu %u\n", cpu);
+#else
+    (void) cpu;
+#endif
+}
+
+void worker(uint32_t id) {
+    if (opt.pin)
+        pin_thread(id % std::thread::hardware_concurrency());
+    gameboy *gb = create_gameboy();
+    gameboy *twin = opt.check_determinism ? create_gameboy() : NULL;
+    if (gb == NULL || (opt.check_determinism && twin == NULL)) {
+        fprintf(stderr, "worker %u: out of memory\n", id);
+        destroy_gameboy(gb);
+        return;
+    }
+    uint32_t index;
+    while (next_job(id, &index)) {
+        job_result res = run_job(gb, twin, &jobs[index]);
+        write_result(index, &jobs[index], &res);
+        status_count[res.status]++;
+        frames_done += res.frames;
+        jobs_done++;
+    }
+    destroy_gameboy(twin);
+    destroy_gameboy(gb);
+}
+
+#ifndef _WIN32
+//worker process: claim jobs until the queue is empty
+void worker_process(uint32_t id) {
+    if (opt.pin)
+        pin_thread(id % std::thread::hardware_concurrency());
+    gameboy *gb = create_gameboy();
+    gameboy *twin = opt.check_determinism ? create_gameboy() : NULL;
+    if (gb == NULL || (opt.check_determinism && twin == NULL))
+        _exit(1);
+    uint32_t index;
+    while ((index = shared->next_job) < jobs.size()) {
+        uint32_t pending = SLOT_PENDING;
+        int claimed = slots[index].state.compare_exchange_strong(pending, SLOT_RUNNING_BY(id));
+        //whoever sees the job taken moves next_job past it, also when its worker died right after the claim
+        shared->next_job.compare_exchange_strong(index, index + 1);
+        if (!claimed)
+            continue;
+        slots[index].result = run_job(gb, twin, &jobs[index]);
+        slots[index].state = SLOT_DONE;
+    }
+    destroy_gameboy(twin);
+    destroy_gameboy(gb);
+    _exit(0);
+}
+
+pid_t spawn_worker(uint32_t id) {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0)
+        worker_process(id);
+    if (pid < 0)
+        fprintf(stderr, "cannot fork worker %u\n", id);
+    return pid;
+}
+
+//write out every result that finished since the last call
+uint32_t collect_results(uint32_t *written) {
+    while (*written < jobs.size() && slots[*written].state == SLOT_WRITTEN)
+        (*written)++;
+    for (uint32_t i = *written; i < jobs.size(); i++) {
+        if (slots[i].state != SLOT_DONE)
+            continue;
+        job_result &res = slots[i].result;
+        write_result(i, &jobs[i], &res);
+        status_count[res.status]++;
+        frames_done += res.frames;
+        jobs_done++;
+        slots[i].state = SLOT_WRITTEN;
+    }
+    return jobs_done;
+}
+
+int run_processes() {
+    size_t size = sizeof(shared_farm) + sizeof(job_slot) * jobs.size();
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "cannot map shared memory\n");
+        return -1;
+    }
+    //anonymous memory is zero filled: next_job 0 and every slot pending
+    shared = (shared_farm *) base;
+    slots = (job_slot *) (shared + 1);
+    std::vector<pid_t> pids(opt.processes);
+    for (uint32_t i = 0; i < opt.processes; i++)
+        pids[i] = spawn_worker(i);
+
+    uint32_t written = 0;
+    uint32_t alive = opt.processes;
+    while (alive > 0) {
+        int wstatus;
+        pid_t pid = waitpid(-1, &wstatus, WNOHANG);
+        if (pid == 0) {
+            collect_results(&written);
+            usleep(1000);
+            continue;
+        }
+        if (pid < 0)
+            break;
+        uint32_t id = 0;
+        while (id < opt.processes && pids[id] != pid)
+            id++;
+        if (id == opt.processes)
+            continue;
+        alive--;
+        int crashed = !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0;
+        //a worker runs one job at a time, the one still running by it is the one it died on
+        for (uint32_t job = 0; crashed && job < jobs.size(); job++) {
+            if (slots[job].state == SLOT_RUNNING_BY(id)) {
+                fprintf(stderr, "worker %u died on job %u\n", id, job);
+                slots[job].result.status = JOB_CRASH;
+                slots[job].state = SLOT_DONE;
+                break;
+            }
+        }
+        //replace the worker while there are jobs left to claim
+        if (crashed && shared->next_job < jobs.size()) {
+            pids[id] = spawn_worker(id);
+            if (pids[id] > 0)
+                alive++;
+        }
+    }
+    collect_results(&written);
+    munmap(base, size);
+    return 0;
+}
+#endif
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            opt.output = argv[++i];
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            opt.threads = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--processes") == 0 && i + 1 < argc)
+            opt.processes = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--pin") == 0)
+            opt.pin = 1;
+        else if (strcmp(argv[i], "--render") == 0)
+            opt.draw = 1;
+        else if (strcmp(argv[i], "--max-cycles") == 0 && i + 1 < argc)
+            opt.max_cycles = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--max-seconds") == 0 && i + 1 < argc)
+            opt.max_seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--hang-frames") == 0 && i + 1 < argc)
+            opt.hang_frames = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--check-determinism") == 0)
+            opt.check_determinism = 1;
+        else if (argv[i][0] != '-' && opt.manifest == NULL)
+            opt.manifest = argv[i];
+        else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (opt.manifest == NULL) {
+        fprintf(stderr, "usage: gbfarm manifest.txt [-o results.jsonl] [--threads n | --processes n] [--pin] [--render]\n"
+                        "                           [--max-cycles n] [--max-seconds s] [--hang-frames n] [--check-determinism]\n");
+        return 1;
+    }
+    if (load_manifest(opt.manifest) < 0)
+        return 1;
+    if (opt.threads == 0)
+        opt.threads = std::thread::hardware_concurrency();
+    if (opt.threads == 0)
+        opt.threads = 1;
+    results = opt.output != NULL ? fopen(opt.output, "w") : stdout;
+    if (results == NULL) {
+        fprintf(stderr, "cannot open %s\n", opt.output);
+        return 1;
+    }
+
+    auto start = farm_clock::now();
+    if (opt.processes > FARM_MAX_PROCESSES) {
+        fprintf(stderr, "--processes is at most %d\n", FARM_MAX_PROCESSES);
+        return 1;
+    }
+    if (opt.processes > 0) {
+#ifdef _WIN32
+        fprintf(stderr, "--processes is not supported on windows\n");
+        return 1;
+#else
+        if (run_processes())
+            return 1;
+        opt.threads = opt.processes;
+#endif
+    } else {
+        //round robin so every worker starts with a mix of the manifest
+        queues = new work_queue[opt.threads];
+        for (uint32_t i = 0; i < jobs.size(); i++)
+            queues[i % opt.threads].jobs.push_front(i);
+        std::vector<std::thread> workers;
+        for (uint32_t i = 0; i < opt.threads; i++)
+            workers.emplace_back(worker, i);
+        for (std::thread &t : workers)
+            t.join();
+    }
+    double seconds = std::chrono::duration<double>(farm_clock::now() - start).count();
+
+    fprintf(stderr, "jobs: %u\nworkers: %u\nseconds: %.3f\njobs_per_second: %.1f\nframes_per_second: %.0f\n",
+            jobs_done.load(), opt.threads, seconds, seconds > 0 ? jobs_done / seconds : 0,
+            seconds > 0 ? frames_done / seconds : 0);
+    int failed = 0;
+    for (int i = 0; i < JOB_STATUS_COUNT; i++) {
+        fprintf(stderr, "%s: %u\n", status_names[i], status_count[i].load());
+        if (i != JOB_OK)
+            failed += status_count[i];
+    }
+    if (results != stdout)
+        fclose(results);
+    delete[] queues;
+    for (farm_job &job : jobs) {
+        free(job.rom);
+        free(job.input);
+    }
+    return failed ? 2 : 0;
+}
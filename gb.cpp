@@ -0,0 +1,2246 @@
+#include <new>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "gb.h"
+#include "statehash.h"
+
+
+//new powered off instance, NULL if out of memory
+gameboy *create_gameboy() {
+    gameboy *gb = new (std::nothrow) gameboy();
+    if (gb == NULL)
+        return NULL;
+    //render scratch, allocated once so the frame loop never touches the heap
+    gb->scratch.base = (uint8_t *) malloc(FRAME_ARENA_SIZE);
+    if (gb->scratch.base == NULL) {
+        delete gb;
+        return NULL;
+    }
+    gb->scratch.size = FRAME_ARENA_SIZE;
+    gb->verbose = 1;
+    gb->breakpoint = 0xFFFF;
+    release_shared(gb);
+    return gb;
+}
+
+void destroy_gameboy(gameboy *gb) {
+    if (gb == NULL)
+        return;
+    release_shared(gb);
+    free(gb->scratch.base);
+    delete gb;
+}
+
+//0x4000-0x7FFF reads the rom bank, its pages in mem only take the writes
+static inline int rom_bank_page(int n) {
+    return n >= (ROM1 >> PAGE_SHIFT) && n < (VRAM >> PAGE_SHIFT);
+}
+
+//block of size bytes with one reference, NULL if out of memory
+uint8_t *share_alloc(size_t size) {
+    //malloc only aligns to 16, the header takes a whole cache line and the data starts on the next one
+    uint8_t *base = (uint8_t *) ::operator new(sizeof(shared_block) + size, std::align_val_t(alignof(shared_block)),
+                                               std::nothrow);
+    if (base == NULL)
+        return NULL;
+    new (base) shared_block{1};
+    return base + sizeof(shared_block);
+}
+
+void share_ref(uint8_t *data) {
+    ((shared_block *) (data - sizeof(shared_block)))->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void share_release(uint8_t *data) {
+    shared_block *b = (shared_block *) (data - sizeof(shared_block));
+    if (b->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        b->~shared_block();
+        ::operator delete(b, std::align_val_t(alignof(shared_block)));
+    }
+}
+
+void release_shared(gameboy *gb) {
+    for (int n = 0; n < PAGE_COUNT; n++) {
+        if (gb->shared_pages >> n & 1)
+            share_release(gb->mem[n]);
+        gb->mem[n] = gb->memory + n * PAGE_SIZE;
+        if (!rom_bank_page(n) || gb->cart == NULL)
+            gb->page[n] = gb->mem[n];
+    }
+    gb->shared_pages = 0;
+    if (gb->vram_shared)
+        share_release(gb->vram);
+    gb->vram = gb->vram_home;
+    gb->vram_shared = 0;
+}
+
+void forget_state_hash(gameboy *gb) {
+    gb->hashing = 0;
+    gb->vram_hashed = 0;
+}
+
+__attribute__((noinline, cold)) void unshare_page(gameboy *gb, int n) {
+    uint8_t *home = gb->memory + n * PAGE_SIZE;
+    memcpy(home, gb->mem[n], PAGE_SIZE);
+    share_release(gb->mem[n]);
+    gb->mem[n] = home;
+    if (!rom_bank_page(n))
+        gb->page[n] = home;
+    gb->shared_pages &= ~(1 << n);
+}
+
+//move the pages of gb that are still its own to shared blocks, -1 if out of memory
+static int share_pages(gameboy *gb) {
+    for (int n = 0; n < PAGE_COUNT; n++) {
+        if (gb->shared_pages >> n & 1)
+            continue;
+        uint8_t *block = share_alloc(PAGE_SIZE);
+        if (block == NULL)
+            return -1;
+        memcpy(block, gb->mem[n], PAGE_SIZE);
+        gb->mem[n] = block;
+        if (!rom_bank_page(n))
+            gb->page[n] = block;
+        gb->shared_pages |= 1 << n;
+    }
+    if (!gb->vram_shared) {
+        uint8_t *block = share_alloc(sizeof(gb->vram_home));
+        if (block == NULL)
+            return -1;
+        memcpy(block, gb->vram, sizeof(gb->vram_home));
+        gb->vram = block;
+        gb->vram_shared = 1;
+    }
+    return 0;
+}
+
+//everything but the pages and vram
+static void copy_machine(const gameboy *from, gameboy *to) {
+    to->reg = from->reg;
+    to->joypad = from->joypad;
+    to->verbose = from->verbose;
+    to->last_amount_cycles = from->last_amount_cycles;
+    to->frame_counter = from->frame_counter;
+    to->offset = from->offset;
+    to->wannadie = from->wannadie;
+    to->total_cycles = from->total_cycles;
+    to->total_instructions = from->total_instructions;
+    to->bank_address = from->bank_address;
+    to->cart = from->cart;
+    to->header = from->header;
+    to->breakpoint = from->breakpoint;
+    memcpy(to->ppu_registers, from->ppu_registers, sizeof(from->ppu_registers));
+    memcpy(to->oam, from->oam, sizeof(from->oam));
+    //the copy starts from the hashes of the original
+    memcpy(to->dirty, from->dirty, sizeof(from->dirty));
+    to->memory_hash = from->memory_hash;
+    to->vram_hash = from->vram_hash;
+    to->hashing = from->hashing;
+    to->vram_hashed = from->vram_hashed;
+    if (from->hashing)
+        memcpy(to->block_hash, from->block_hash, sizeof(from->block_hash));
+}
+
+int freeze_gameboy(gameboy *gb) {
+    return share_pages(gb);
+}
+
+//the pages of parent that are still its own are moved to shared blocks first, so forking a state
+//that was forked before only copies the cpu state and takes a reference on every page
+//returns -1 if out of memory, child is then left powered off
+int fork_gameboy(gameboy *parent, gameboy *child) {
+    if (share_pages(parent) != 0)
+        return -1;
+    release_shared(child);
+    for (int n = 0; n < PAGE_COUNT; n++) {
+        share_ref(parent->mem[n]);
+        child->mem[n] = parent->mem[n];
+        child->page[n] = parent->page[n];
+    }
+    child->shared_pages = parent->shared_pages;
+    share_ref(parent->vram);
+    child->vram = parent->vram;
+    child->vram_shared = 1;
+    copy_machine(parent, child);
+    return 0;
+}
+
+//a page gb still shares with snapshot was not written since the last reset and is kept, every other one was
+//copied home by its first write, or comes from another snapshot, and goes back to the block of snapshot,
+//so a reset is a few pointer swaps and the cpu state however much was run, the pages are copied again only
+//when they are written
+int reset_gameboy(const gameboy *snapshot, gameboy *gb) {
+    if (snapshot->shared_pages != (1 << PAGE_COUNT) - 1 || !snapshot->vram_shared)
+        return -1;
+    for (int n = 0; n < PAGE_COUNT; n++) {
+        if (gb->mem[n] != snapshot->mem[n]) {
+            if (gb->shared_pages >> n & 1)
+                share_release(gb->mem[n]);
+            share_ref(snapshot->mem[n]);
+            gb->mem[n] = snapshot->mem[n];
+        }
+        //the rom bank can differ even when the page is the same
+        gb->page[n] = snapshot->page[n];
+    }
+    gb->shared_pages = snapshot->shared_pages;
+    if (gb->vram != snapshot->vram) {
+        if (gb->vram_shared)
+            share_release(gb->vram);
+        share_ref(snapshot->vram);
+        gb->vram = snapshot->vram;
+        gb->vram_shared = 1;
+    }
+    copy_machine(snapshot, gb);
+    return 0;
+}
+
+//writable byte at address, a shared page is copied back first so writes always land in memory
+static inline uint8_t *store_pointer(gameboy *gb, uint16_t address) {
+    if (__builtin_expect(gb->shared_pages >> (address >> PAGE_SHIFT) & 1, 0))
+        unshare_page(gb, address >> PAGE_SHIFT);
+    if (gb->hashing)
+        gb->dirty[address >> HASH_BLOCK_SHIFT] = 1;
+    return &gb->memory[address];
+}
+
+struct sprite get_sprite(gameboy *gb, uint8_t index){
+    struct sprite s;
+    s.raw = *(uint32_t*)(gb->oam + index * 4);
+    return s;
+}
+
+//64 byte aligned block from the arena, NULL when it is full
+void *arena_alloc(arena *a, size_t size) {
+    size_t start = (a->used + 63) & ~(size_t) 63;
+    if (start + size > a->size)
+        return NULL;
+    a->used = start + size;
+    return a->base + start;
+}
+
+void arena_reset(arena *a) {
+    a->used = 0;
+}
+
+//copy the 40 oam entries to sprites
+void get_sprites(gameboy *gb, sprite *sprites){
+    if(gb->ppu_registers[PPU_LCDC]&LCDC_SPSIZE)
+    { for(int i = 0; i < 40; i++){
+            sprites[i] = get_sprite(gb, i);
+        }
+
+    }
+    else
+    {
+        for(int i = 0; i < 40; i++){
+            sprites[i] = get_sprite(gb, i);
+        }
+    }
+}
+uint8_t draw_sprite(gameboy *gb, uint8_t x, uint8_t y, uint8_t tile_n,uint8_t priority,int size,int xf,int yf)
+{
+    if(xf==0)
+        x=7-x;
+    if(yf==1)
+        y=size-y;
+    if(size==7||y>=8) {
+        if(y>=8)
+            y=y-8;
+
+        y=7-y;
+        uint16_t tile_address = 0x10 * tile_n;
+        uint8_t low = gb->vram[tile_address + y * 2], high = gb->vram[tile_address + y * 2 + 1];
+        uint16_t data = (high << 8) | low;
+        int p = x % 8;
+        uint8_t ret = _pext_u32(data, 0x8080 >> p);
+        //printf("%b\n",ret);
+        return ret;
+    }else{
+        if(y<8){
+            y=7-y;
+            uint16_t tile_address = 0x10 * (tile_n+1);
+            uint8_t low = gb->vram[tile_address + y * 2], high = gb->vram[tile_address + y * 2 + 1];
+            uint16_t data = (high << 8) | low;
+            int p = x % 8;
+            uint8_t ret = _pext_u32(data, 0x8080 >> p);
+            return _pext_u32(data, 0x8080 >> p);
+        }
+    }
+
+
+
+}
+uint8_t draw_window_pixel(gameboy *gb, uint8_t y,uint8_t x) {
+    uint8_t y_offset = gb->ppu_registers[PPU_WY];
+    uint8_t x_offset = gb->ppu_registers[PPU_WX];
+    uint16_t windo_tile_map_offset =gb->ppu_registers[PPU_LCDC] & 0x40 ? 0x1C00 : 0x1800;
+    y=y-y_offset;
+    x=x-x_offset;
+    uint8_t tile_n = gb->vram[windo_tile_map_offset + (y >> 3) * 32 + (x >> 3)];
+    int8_t tile_n_signed = tile_n;
+    uint8_t y_in_tile = y % 8;
+    uint8_t x_in_tile = x % 8;
+    uint16_t offset = (gb->ppu_registers[PPU_LCDC] & 0x10) ? 0x0 : 0x1000;
+    uint16_t tile_address;
+    if (offset==0x1000){
+        tile_address=offset+0x10*tile_n_signed;
+    } else{
+        tile_address=offset+0x10*tile_n;
+    }
+    uint8_t low = gb->vram[tile_address + y_in_tile * 2], high = gb->vram[tile_address + y_in_tile * 2 + 1];
+    uint16_t data = (high << 8) | low;
+    int p = x_in_tile% 8;
+    uint8_t ret = _pext_u32(data, 0x8080 >> p);
+    return ret;
+}
+
+uint8_t draw_pixel(gameboy *gb, uint8_t y,uint8_t x){
+    //if bit 3 of the lcdc is set, the offset is 0x1000 else 0x0
+    uint16_t offset = (gb->ppu_registers[PPU_LCDC] & 0x10) ? 0x0 : 0x1000;
+    uint16_t bgmap_offset = (gb->ppu_registers[PPU_LCDC] & 0x8)? 0x1C00 : 0x1800;
+    int tx=x>>3,
+            ty=y>>3;
+    uint16_t addr=bgmap_offset+(ty*0x20)+ tx;
+    int8_t tile_n=gb->vram[addr];
+    uint8_t tile_nunsigned=tile_n;
+    uint16_t tile_address;
+    if (offset==0x1000){
+        tile_address=offset+0x10*tile_n;
+    } else{
+        tile_address=offset+0x10*tile_nunsigned;
+    }
+    uint8_t low = gb->vram[tile_address+(y%8)*2], high = gb->vram[tile_address+(y%8)*2 + 1];
+    uint16_t data = (high << 8) | low;
+    int p = x%8;
+    return  _pext_u32(data, 0x8080 >> p)&0x03;
+}
+
+//gray level and color of every palette index
+const uint8_t default_gray[4] = {255, 170, 85, 0};
+const uint32_t default_rgba[4] = {0xFFC8FFE0, 0x6490B298, 0xC8586550, 0xFF000000};
+
+//draw line i of the frame as palette indexes: background, then the window over it, then the sprites
+static void render_line(gameboy *gb, int i, const sprite *sprites, int size, uint8_t *line, uint8_t *sprite_line) {
+    for (int j = 0; j < 256; j++)
+        line[j] = draw_pixel(gb, i, j);
+    //an enabled window covers the whole line
+    if (gb->ppu_registers[PPU_LCDC] & 0x20) {
+        for (int j = 0; j < 256; j++)
+            line[j] = draw_window_pixel(gb, i, j) & 0x03;
+    }
+    //later sprites overwrite earlier ones, transparent pixels included
+    memset(sprite_line, 0, 256);
+    for (int s = 0; s < 40; s++) {
+        int y = sprites[s].y - i;
+        if (i <= 0 || y < 0 || y > size)
+            continue;
+        for (int x = 7; x >= 0; x--) {
+            if (sprites[s].x - x > 0)
+                sprite_line[sprites[s].x - x] = draw_sprite(gb, x, y, sprites[s].tile, sprites[s].attr & 0x80, size,
+                                                            (sprites[s].attr & 0x20) >> 5, (sprites[s].attr & 0x40) >> 6) & 0x03;
+        }
+    }
+    for (int j = 0; j < 256; j++)
+        line[j] = sprite_line[j] != 0 ? sprite_line[j] : line[j];
+}
+
+//convert one line of palette indexes to a row of t, prev is the line above for the 2x2 average
+static void store_line(const render_target *t, const uint8_t *line, const uint8_t *prev, uint8_t *out, int width) {
+    const uint32_t *palette = t->palette != NULL ? t->palette : default_rgba;
+    int ds = t->downscale == 2 ? 2 : 1;
+    switch (t->format) {
+        case PIXEL_INDEX8:
+            for (int k = 0; k < width; k++)
+                out[k] = line[k * ds];
+            break;
+        case PIXEL_PACKED2:
+            memset(out, 0, (width + 3) / 4);
+            for (int k = 0; k < width; k++)
+                out[k >> 2] |= line[k * ds] << ((k & 3) * 2);
+            break;
+        case PIXEL_GRAY8:
+            if (ds == 1) {
+                for (int k = 0; k < width; k++)
+                    out[k] = default_gray[line[k]];
+            } else {
+                for (int k = 0; k < width; k++)
+                    out[k] = (default_gray[prev[2 * k]] + default_gray[prev[2 * k + 1]] +
+                              default_gray[line[2 * k]] + default_gray[line[2 * k + 1]] + 2) >> 2;
+            }
+            break;
+        case PIXEL_RGBA32:
+            if (ds == 1) {
+                for (int k = 0; k < width; k++)
+                    memcpy(out + 4 * k, &palette[line[k]], 4);
+            } else {
+                for (int k = 0; k < width; k++) {
+                    uint32_t c[4] = {palette[prev[2 * k]], palette[prev[2 * k + 1]], palette[line[2 * k]], palette[line[2 * k + 1]]};
+                    for (int b = 0; b < 32; b += 8)
+                        out[4 * k + b / 8] = (((c[0] >> b) & 0xFF) + ((c[1] >> b) & 0xFF) + ((c[2] >> b) & 0xFF) + ((c[3] >> b) & 0xFF) + 2) >> 2;
+                }
+            }
+            break;
+    }
+}
+
+//visible width and height of t after the crop and the downscale
+static void target_extent(const render_target *t, int *width, int *height) {
+    int ds = t->downscale == 2 ? 2 : 1;
+    int w = t->width != 0 && t->width < 256 - t->x ? t->width : 256 - t->x;
+    int h = t->height != 0 && t->height < 256 - t->y ? t->height : 256 - t->y;
+    *width = w / ds;
+    *height = h / ds;
+}
+
+size_t render_target_size(const render_target *t, size_t *row_bytes) {
+    int width, height;
+    target_extent(t, &width, &height);
+    size_t row = t->format == PIXEL_RGBA32 ? 4 * width : t->format == PIXEL_PACKED2 ? (width + 3) / 4 : width;
+    if (row_bytes != NULL)
+        *row_bytes = row;
+    return row * height;
+}
+
+//draw the frame into t one line at a time, only the lines inside its rectangle are drawn
+void render_to(gameboy *gb, const render_target *t) {
+    arena_reset(&gb->scratch);
+    sprite *sprites = (sprite *) arena_alloc(&gb->scratch, sizeof(sprite) * 40);
+    get_sprites(gb, sprites);
+    uint8_t *line = (uint8_t *) arena_alloc(&gb->scratch, 256);
+    uint8_t *prev = (uint8_t *) arena_alloc(&gb->scratch, 256);
+    uint8_t *sprite_line = (uint8_t *) arena_alloc(&gb->scratch, 256);
+    //if sprite size y go from 16
+    int size = gb->ppu_registers[PPU_LCDC] & LCDC_SPSIZE ? 15 : 7;
+
+    int width, height;
+    size_t row_bytes;
+    target_extent(t, &width, &height);
+    render_target_size(t, &row_bytes);
+    ptrdiff_t stride = t->stride != 0 ? t->stride : (ptrdiff_t) row_bytes;
+    int ds = t->downscale == 2 ? 2 : 1;
+    //the index formats only need the top left pixel of every 2x2 block
+    int average = ds == 2 && (t->format == PIXEL_GRAY8 || t->format == PIXEL_RGBA32);
+    for (int row = 0; row < height * ds; row++) {
+        if (ds == 2 && !average && (row & 1))
+            continue;
+        render_line(gb, t->y + row, sprites, size, line, sprite_line);
+        if (average && !(row & 1)) {
+            uint8_t *swap = prev;
+            prev = line;
+            line = swap;
+            continue;
+        }
+        store_line(t, line + t->x, prev + t->x, t->pixels + (row / ds) * stride, width);
+    }
+}
+
+//draw the frame to the output of the instance, the framebuffer if it has none
+void render(gameboy *gb) {
+    if (gb->output != NULL) {
+        render_to(gb, gb->output);
+        return;
+    }
+    render_target t = {&gb->framebuffer[0][0], screen_width, PIXEL_INDEX8, 1, 0, 0, 0, 0, NULL};
+    render_to(gb, &t);
+}
+
+//copy vram, oam and the ppu registers for the next frame
+void latch_ppu(gameboy *gb) {
+    const uint8_t *high = gb->mem[0xF000 >> PAGE_SHIFT];
+    memcpy(gb->oam, high + (0xFE00 & (PAGE_SIZE - 1)), 0xA0);
+    //the whole latch is overwritten, a shared one is dropped instead of copied
+    if (gb->vram_shared) {
+        share_release(gb->vram);
+        gb->vram = gb->vram_home;
+        gb->vram_shared = 0;
+    }
+    memcpy(gb->vram, gb->mem[VRAM >> PAGE_SHIFT], PAGE_SIZE);
+    memcpy(gb->vram + PAGE_SIZE, gb->mem[(VRAM >> PAGE_SHIFT) + 1], PAGE_SIZE);
+    memcpy(gb->ppu_registers, high + (0xFF40 & (PAGE_SIZE - 1)), 0xc);
+    if (gb->hashing)
+        hash_latched_vram(gb);
+    else
+        gb->vram_hashed = 0;
+}
+
+
+//memory read
+uint8_t read_memory(gameboy *gb, uint16_t address) {
+    return gb->page[address >> PAGE_SHIFT][address & (PAGE_SIZE - 1)];
+}
+
+//mem read 16bit
+uint16_t read_memory16(gameboy *gb, uint16_t address) {
+    return read_memory(gb, address) | (read_memory(gb, address+1) << 8);
+}
+
+//mem write 16bit
+void write_memory16(gameboy *gb, uint16_t address, uint16_t* value) {
+    if (address < 0x8000) {
+    } else {
+        *store_pointer(gb, address) = *value & 0xFF;
+        *store_pointer(gb, address + 1) = (*value >> 8) & 0xFF;
+    }
+}
+
+
+//mem init
+void mem_init(gameboy *gb) {
+    release_shared(gb);
+    forget_state_hash(gb);
+    memset(gb->memory, 0, sizeof(gb->memory));
+    unsigned char ioReset[0x100] = {
+            0x0F, 0x00, 0x7C, 0xFF, 0x00, 0x00, 0x00, 0xF8, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01,
+            0x80, 0xBF, 0xF3, 0xFF, 0xBF, 0xFF, 0x3F, 0x00, 0xFF, 0xBF, 0x7F, 0xFF, 0x9F, 0xFF, 0xBF, 0xFF,
+            0xFF, 0x00, 0x00, 0xBF, 0x77, 0xF3, 0xF1, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+            0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF,
+            0x91, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFC, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x7E, 0xFF, 0xFE,
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xC0, 0xFF, 0xC1, 0x00, 0xFE, 0xFF, 0xFF, 0xFF,
+            0xF8, 0xFF, 0x00, 0x00, 0x00, 0x8F, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+            0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
+            0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E, 0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
+            0xBB, 0xBB, 0x67, 0x63, 0x6E, 0x0E, 0xEC, 0xCC, 0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E,
+            0x45, 0xEC, 0x52, 0xFA, 0x08, 0xB7, 0x07, 0x5D, 0x01, 0xFD, 0xC0, 0xFF, 0x08, 0xFC, 0x00, 0xE5,
+            0x0B, 0xF8, 0xC2, 0xCE, 0xF4, 0xF9, 0x0F, 0x7F, 0x45, 0x6D, 0x3D, 0xFE, 0x46, 0x97, 0x33, 0x5E,
+            0x08, 0xEF, 0xF1, 0xFF, 0x86, 0x83, 0x24, 0x74, 0x12, 0xFC, 0x00, 0x9F, 0xB4, 0xB7, 0x06, 0xD5,
+            0xD0, 0x7A, 0x00, 0x9E, 0x04, 0x5F, 0x41, 0x2F, 0x1D, 0x77, 0x36, 0x75, 0x81, 0xAA, 0x70, 0x3A,
+            0x98, 0xD1, 0x71, 0x02, 0x4D, 0x01, 0xC1, 0xFF, 0x0D, 0x00, 0xD3, 0x05, 0xF9, 0x00, 0x0B, 0x00
+    };
+    //copy from IO reset to memory from 0xFF00
+    memcpy(&gb->memory[0xFF00],ioReset, sizeof(ioReset));
+    for (int i = 0; i < PAGE_COUNT; i++)
+        gb->page[i] = gb->mem[i];
+}
+
+//reg init
+void reg_init(gameboy *gb) {
+    gb->reg.AF = 0x01b0;
+    gb->reg.BC = 0x0013;
+    gb->reg.DE = 0x00d8;
+    gb->reg.HL = 0x014d;
+    gb->reg.SP = 0xfffe;
+    gb->reg.PC = 0x0100;
+}
+
+
+//load rom from path, returns 0 on success
+int load_rom_file(rom *r, const char *path) {
+    FILE *rom_file;
+    rom_file = fopen(path, "rb");
+    if (rom_file == NULL) {
+        printf("cannot open rom %s\n", path);
+        return -1;
+    }
+    fseek(rom_file, 0, SEEK_END);
+    long size = ftell(rom_file);
+    fseek(rom_file, 0, SEEK_SET);
+    r->size = size > ROM_MIN_SIZE ? size : ROM_MIN_SIZE;
+    r->mapped = 0;
+    r->buffer = (uint8_t *) calloc(r->size, 1);
+    if (r->buffer == NULL || fread(r->buffer, 1, size, rom_file) != (size_t) size) {
+        printf("cannot read rom %s\n", path);
+        free(r->buffer);
+        r->buffer = NULL;
+        fclose(rom_file);
+        return -1;
+    }
+    fclose(rom_file);
+    return 0;
+}
+
+//copy a rom image that is already in memory, returns 0 on success
+int load_rom_buffer(rom *r, const uint8_t *data, size_t size) {
+    r->size = size > ROM_MIN_SIZE ? size : ROM_MIN_SIZE;
+    r->mapped = 0;
+    r->buffer = (uint8_t *) calloc(r->size, 1);
+    if (r->buffer == NULL || data == NULL) {
+        printf("cannot load rom buffer\n");
+        free(r->buffer);
+        r->buffer = NULL;
+        return -1;
+    }
+    memcpy(r->buffer, data, size);
+    return 0;
+}
+
+//map the rom file read only instead of reading it, pages are shared with the page cache
+//and every other process mapping the same file, returns 0 on success
+int map_rom_file(rom *r, const char *path) {
+#ifdef _WIN32
+    return load_rom_file(r, path);
+#else
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        printf("cannot open rom %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    //zero pages for the padding up to ROM_MIN_SIZE, the file is mapped over the start of them
+    size_t size = st.st_size > ROM_MIN_SIZE ? st.st_size : ROM_MIN_SIZE;
+    void *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED ||
+        mmap(base, st.st_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        printf("cannot map rom %s\n", path);
+        if (base != MAP_FAILED)
+            munmap(base, size);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    r->buffer = (uint8_t *) base;
+    r->size = size;
+    r->mapped = 1;
+    return 0;
+#endif
+}
+
+void free_rom(rom *r) {
+#ifndef _WIN32
+    if (r->mapped) {
+        munmap(r->buffer, r->size);
+        r->buffer = NULL;
+        r->size = 0;
+        r->mapped = 0;
+        return;
+    }
+#endif
+    free(r->buffer);
+    r->buffer = NULL;
+    r->size = 0;
+}
+
+//power on with the rom r, which has to outlive the instance
+void machine_init(gameboy *gb, const rom *r) {
+    mem_init(gb);
+    reg_init(gb);
+    memset(gb->vram, 0, sizeof(gb->vram_home));
+    memset(gb->oam, 0, sizeof(gb->oam));
+    memset(gb->ppu_registers, 0, sizeof(gb->ppu_registers));
+    gb->offset = 0;
+    gb->joypad = 0;
+    gb->wannadie = 0;
+    gb->last_amount_cycles = 0;
+    gb->frame_counter = FRAME_CYCLES;
+    gb->total_cycles = 0;
+    gb->total_instructions = 0;
+    gb->cart = r;
+    memcpy(gb->memory, r->buffer, 0x4000);
+    map_rom_bank(gb, 0x4000);
+    load_header(gb);
+    //init ime
+    gb->reg.ime = true;
+}
+
+//read an input recording, one JOYPAD_ mask per frame, NULL on error
+uint8_t *load_input(const char *path, size_t *length) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        printf("cannot open input %s\n", path);
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t *input = (uint8_t *) malloc(size > 0 ? size : 1);
+    *length = fread(input, 1, size, fp);
+    fclose(fp);
+    return input;
+}
+
+//load cartridge header from rom r to header starting from 0x100
+void load_header(gameboy *gb) {
+    cartridge_header &header = gb->header;
+    const uint8_t *buffer = gb->cart->buffer;
+    for (int i = 0; i < 48; i++) {
+        header.logo[i] = buffer[i + 0x100];
+    }
+    for (int i = 0; i < 16; i++) {
+        header.title[i] = buffer[i + 0x134];
+    }
+    header.type = buffer[0x147];
+    header.rom_size = buffer[0x148];
+    header.ram_size = buffer[0x149];
+    header.destination_code = buffer[0x14A];
+    header.old_license_code = buffer[0x14B];
+    header.mask_rom_version = buffer[0x14C];
+    header.header_checksum = buffer[0x14D];
+    header.global_checksum[0] = buffer[0x14E];
+    header.global_checksum[1] = buffer[0x14F];
+}
+
+
+
+
+//print cartridge header
+void print_cartridge_header(gameboy *gb) {
+    cartridge_header &header = gb->header;
+    printf("Title: %s\n", header.title);
+    printf("Type: %d\n", header.type);
+    printf("ROM Size: %d\n", header.rom_size);
+    printf("RAM Size: %d\n", header.ram_size);
+    printf("Destination Code: %d\n", header.destination_code);
+    printf("Old License Code: %d\n", header.old_license_code);
+    printf("Mask ROM Version: %d\n", header.mask_rom_version);
+    printf("Header Checksum: %d\n", header.header_checksum);
+    printf("Global Checksum: %s\n", header.global_checksum);
+}
+//typedef 5 bit bank number
+//switch rom bank
+//map the rom at bank_address to 0x4000-0x7FFF
+void map_rom_bank(gameboy *gb, uint32_t bank_address) {
+    gb->bank_address = bank_address;
+    for (int i = 0; i < 0x4000 / PAGE_SIZE; i++)
+        gb->page[(0x4000 / PAGE_SIZE) + i] = gb->cart->buffer + bank_address + i * PAGE_SIZE;
+}
+
+void switch_rom_bank(gameboy *gb, bank_number bank) {
+    uint32_t bank_address;
+    if (bank.bank == 0) {
+        return;
+    } else if (bank.bank == 1) {
+        bank_address = 0x4000;
+    } else {
+        bank_address = 0x8000 + (bank.bank - 2) * 0x4000;
+    }
+    //print bank number
+    if (gb->verbose)
+        printf("address %0X\n", bank_address);
+    gb->offset=bank_address;
+    map_rom_bank(gb, bank_address);
+}
+
+#define RBN 0x2000
+
+//write to rom register
+void write_to_rom_register(gameboy *gb, uint16_t address, uint8_t value) {
+
+    if (address > RBN && address < RBN + 0x2000) {
+        bank_number bank;
+        bank.value = value;
+        switch_rom_bank(gb, bank);
+    }
+}
+
+//joypad register, the low nibble reads the buttons of the group selected by bit 4 (directions) or bit 5 (buttons)
+uint8_t joypad_register(gameboy *gb, uint8_t select) {
+    uint8_t value = 0xCF | (select & 0x30);
+    if (!(select & 0x10))
+        value &= ~(gb->joypad & 0x0F);
+    if (!(select & 0x20))
+        value &= ~(gb->joypad >> 4);
+    return value;
+}
+
+//set the pressed buttons, see JOYPAD_ masks
+void set_joypad(gameboy *gb, uint8_t buttons) {
+    gb->joypad = buttons;
+    uint8_t *p = store_pointer(gb, Control);
+    *p = joypad_register(gb, *p);
+}
+
+//write memory
+void write_memory(gameboy *gb, uint16_t address, uint8_t value) {
+    if (address < 0x8000) {
+        write_to_rom_register(gb, address, value);
+    } else if (address == Control) {
+        value = joypad_register(gb, value);
+    }
+    *store_pointer(gb, address) = value;
+}
+
+
+void cpu_step(gameboy *gb, uint8_t opcode) {
+    registers &reg = gb->reg;
+    unsigned int &last_amount_cycles = gb->last_amount_cycles;
+    reg.PC++;
+    uint8_t temp, cb_opcode;
+    uint16_t temp16;
+    unsigned int adjustment = 0;
+    uint8_t * regs[] = {&reg.B, &reg.C, &reg.D, &reg.E, &reg.H, &reg.L,nullptr, &reg.A};
+
+    if(opcode==0xF1){
+
+    //   printf("%d\n",reg.A);
+        gb->wannadie=1;
+    }
+    switch (opcode) {
+        case 0x00://NOP
+            last_amount_cycles=1;
+            break;
+        case 0x01://LD BC,d16
+            reg.BC = read_memory16(gb, reg.PC);
+            last_amount_cycles=3;
+            reg.PC += 2;
+            break;
+        case 0x02://LD (BC),A
+            write_memory(gb, reg.BC, reg.AF & 0x00FF);
+            last_amount_cycles=2;
+            break;
+        case 0x03://INC BC
+            reg.BC++;
+            last_amount_cycles=2;
+            break;
+        case 0x04://INC B
+            reg.h=(reg.B&0x0F)==0x0F;
+            reg.B++;
+            reg.z = (reg.B == 0);
+            reg.n = 0;
+            last_amount_cycles=1;
+            break;
+        case 0x05://DEC B
+            reg.h=(reg.B&0x0F)==0x00;
+            reg.B--;
+            reg.z = (reg.B == 0);
+            reg.n = 0;
+            last_amount_cycles=1;
+            break;
+        case 0x06://LD B,d8
+            reg.B = read_memory(gb, reg.PC);
+            reg.PC++;
+            last_amount_cycles=2;
+            break;
+        case 0x07://RLCA rotate A left. Old bit 7 to Carry flag
+            reg.F = 0x00;
+            reg.c = reg.A >> 7;
+            reg.A = (reg.A << 1) | (reg.A >> 7);
+            reg.z = 1 * (reg.A == 0);
+            last_amount_cycles=1;
+            break;
+        case 0x08://LD (a16),SP
+            write_memory16(gb, read_memory16(gb, reg.PC), &reg.SP);
+            reg.PC += 2;
+            last_amount_cycles=5;
+            break;
+        case 0x09://ADD HL,BC
+            temp = reg.HL;
+            reg.HL += reg.BC;
+            reg.z = (reg.HL == 0);
+            reg.n = 0;
+            reg.h = (temp & 0xFFF) + (reg.BC & 0xFFF) > 0xFFF;
+            reg.c = reg.HL >0xFFFF;
+            last_amount_cycles=2;
+            break;
+        case 0x0A://LD A,(BC)
+            reg.A = read_memory(gb, reg.BC);
+            last_amount_cycles=2;
+            break;
+        case 0x0B://DEC BC
+            reg.BC--;
+            last_amount_cycles=2;
+            break;
+        case 0x0C://INC C
+            reg.h=(reg.C&0x0F)==0x0F;
+            reg.C++;
+            reg.z = (reg.C == 0);
+            reg.n = 0;
+            last_amount_cycles=1;
+            break;
+        case 0x0D://DEC C
+            reg.h=(reg.C&0x0F)==0x00;
+            reg.C--;
+            reg.z = (reg.C == 0);
+            reg.n = 0;
+            last_amount_cycles=1;
+            break;
+        case 0x0E://LD C,d8
+            reg.C = read_memory(gb, reg.PC);
+            reg.PC++;
+            last_amount_cycles=2;
+            break;
+        case 0x0F://RRCA rotate A right. Old bit 0 to Carry flag
+            reg.F = 0x00;
+            reg.c = reg.A >> 7;
+            reg.A = (reg.A >> 1) | (reg.A << 7);
+            reg.z = 1 * (reg.A == 0);
+            last_amount_cycles=1;
+            break;
+        case 0x10://STOP not yet implemented
+            reg.PC++;
+            last_amount_cycles=4;
+            break;
+        case 0x11://LD DE,d16
+            reg.DE = read_memory16(gb, reg.PC);
+            reg.PC += 2;
+            last_amount_cycles=3;
+            break;
+        case 0x12://LD (DE),A
+            write_memory(gb, reg.DE, reg.A);
+            last_amount_cycles=2;
+            break;
+        case 0x13://INC DE
+            reg.DE++;
+            last_amount_cycles=2;
+            break;
+        case 0x14://INC D
+            reg.h=(reg.D&0x0F)==0x0F;
+            reg.D++;
+            reg.z = (reg.D == 0);
+            reg.n = 0;
+            last_amount_cycles=1;
+            break;
+        case 0x15://DEC D
+            reg.h=(reg.D&0x0F)==0x00;
+            reg.D--;
+            reg.z = (reg.B == 0);
+            reg.n = 0;
+            last_amount_cycles=1;
+            break;
+        case 0x16://LD D,d8
+            reg.D = read_memory(gb, reg.PC);
+            reg.PC++;
+            last_amount_cycles=2;
+            break;
+        case 0x17://RLA rotate A left through Carry flag
+            reg.F = 0x00;
+            reg.c = reg.A >> 7;
+            temp = reg.c;
+            reg.A = (reg.A << 1) | temp;
+            reg.z = 1 * (reg.A == 0);
+            last_amount_cycles=1;
+            break;
+        case 0x18://JR r8
+            reg.PC +=(int8_t) read_memory(gb, reg.PC++);
+            last_amount_cycles=3;
+            break;
+        case 0x19://ADD HL,DE
+        temp = reg.HL;
+            reg.HL += reg.DE;
+            reg.z = (reg.HL == 0);
+            reg.n = 0;
+            reg.h = (temp & 0xFFF) + (reg.DE & 0xFFF) > 0xFFF;
+            reg.c = reg.HL >0xFFFF;
+            last_amount_cycles=2;
+            break;
+        case 0x1A://LD A,(DE)
+            reg.A = read_memory(gb, reg.DE);
+            last_amount_cycles=2;
+            break;
+        case 0x1B://DEC DE
+            reg.DE--;
+            last_amount_cycles=2;
+            break;
+        case 0x1C://INC E
+            reg.h=(reg.E&0x0F)==0x0F;
+            reg.E++;
+            reg.z = (reg.E == 0);
+            reg.n = 0;
+            last_amount_cycles=1;
+            break;
+        case 0x1D://DEC E
+            reg.h=(reg.E&0x0F)==0x00;
+            reg.E--;
+            reg.z = (reg.E == 0);
+            reg.n = 0;
+            last_amount_cycles=1;
+            break;
+        case 0x1E://LD E,d8
+            reg.E = read_memory(gb, reg.PC);
+            reg.PC++;
+            last_amount_cycles=2;
+            break;
+        case 0x1F://RRA rotate A right through Carry flag
+            temp = reg.c;
+            reg.F = 0x00;
+            reg.c = reg.A >> 7;
+            reg.A = (reg.A >> 1) | (temp << 7);
+            reg.z = (reg.A == 0);
+            last_amount_cycles=1;
+            break;
+        case 0x20://JR NZ,r8
+            if (reg.z == 0) {
+                reg.PC += (int8_t)read_memory(gb, reg.PC++);
+                last_amount_cycles = 3;
+            } else {
+                reg.PC++;
+                last_amount_cycles = 2;
+            }
+            break;
+        case 0x21://LD HL,d16
+            reg.HL = read_memory16(gb, reg.PC);
+            reg.PC += 2;
+            last_amount_cycles = 3;
+            break;
+        case 0x22://LD (HL+),A
+            write_memory(gb, reg.HL, reg.A);
+            reg.HL++;
+            last_amount_cycles = 2;
+            break;
+        case 0x23://INC HL
+            reg.HL++;
+            last_amount_cycles = 2;
+            break;
+        case 0x24://INC H
+            reg.h=(reg.H&0x0F)==0x0F;
+            reg.H++;
+            reg.z = (reg.H == 0);
+            reg.n = 0;
+            last_amount_cycles = 1;
+            break;
+        case 0x25://DEC H
+            reg.h=(reg.H&0x0F)==0x00;
+            reg.H--;
+            reg.z = (reg.H == 0);
+            reg.n = 0;
+            last_amount_cycles = 1;
+            break;
+        case 0x26://LD H,d8
+            reg.H = read_memory(gb, reg.PC);
+            reg.PC++;
+            last_amount_cycles = 2;
+            break;
+        case 0x27://DAA decimal adjust A
+            if (!reg.n) {
+                if (reg.h || ((reg.A & 0x0F) > 9))
+                    reg.A += 0x06;
+                if (reg.c || (reg.A > 0x99)) {
+                    reg.A += 0x60;
+                    reg.c = 1;
+                }
+            } else {
+                if (reg.c)
+                    reg.A -= 0x60;
+                if (reg.h)
+                    reg.A -= 0x06;
+            }
+            reg.z = (reg.A == 0);
+            reg.h = 0;
+            last_amount_cycles = 1;
+            break;
+        case 0x28://JR Z,r8
+
+            if (reg.z) {
+
+                reg.PC = reg.PC + (int8_t)(read_memory(gb, reg.PC)) + 1;
+                last_amount_cycles = 3;
+            }
+            else{
+                reg.PC++;
+                last_amount_cycles = 2;
+            break;
+        case 0x29://add HL,HL
+            reg.HL += reg.HL;
+            reg.n = 0;
+            reg.h = reg.HL >> 11;
+            reg.c = reg.HL >> 15;
+            last_amount_cycles = 2;
+            break;
+        case 0x2A:// LD A,(HL+)
+            reg.A = read_memory(gb, reg.HL++);
+            last_amount_cycles = 2;
+            break;
+        case 0x2B://DEC DE
+            reg.HL--;
+            last_amount_cycles = 2;
+            break;
+        case 0x2C://INC L
+            reg.h=(reg.L&0x0F)==0x0F;
+            reg.L++;
+            reg.z = (reg.L == 0);
+            reg.n = 0;
+            last_amount_cycles = 1;
+            break;
+        case 0x2D://DEC L
+            reg.L--;
+            reg.z = (reg.L == 0);
+            reg.n = 0;
+            reg.h = reg.L >> 4;
+            last_amount_cycles = 1;
+            break;
+        case 0x2E://LD L,n
+            reg.L = read_memory(gb, reg.PC);
+            reg.PC++;
+            last_amount_cycles = 2;
+            break;
+        case 0x2F://CPL
+            reg.A = ~reg.A;
+            reg.n = 1;
+            reg.h = 1;
+            last_amount_cycles = 1;
+            break;
+        case 0x30://JR NC,e
+            if (reg.c == 0) {
+                reg.PC += (int8_t)read_memory(gb, reg.PC++);
+                last_amount_cycles = 3;
+            } else {
+                reg.PC++;
+                last_amount_cycles = 2;
+            }
+            break;
+        case 0x31://LD SP,nn
+            reg.SP = read_memory16(gb, reg.PC);
+            reg.PC += 2;
+            last_amount_cycles = 3;
+            break;
+        case 0x32://LD (HL-),A
+            write_memory(gb, reg.HL--, reg.A);
+            last_amount_cycles = 2;
+            break;
+        case 0x33://INC SP
+            reg.SP++;
+            last_amount_cycles = 2;
+            break;
+        case 0x34://INC (HL) TODO need to check this
+            temp = read_memory(gb, reg.HL);
+            write_memory(gb, reg.HL, temp + 1);
+            reg.z = temp + 1 == 0;
+            reg.n = 0;
+            reg.h = (temp & 0x0F) == 0x0F;
+            last_amount_cycles = 2;
+            break;
+        case 0x35://DEC (HL)
+            temp = read_memory(gb, reg.HL);
+            write_memory(gb, reg.HL, temp - 1);
+            reg.z = temp - 1 == 0;
+            reg.n = 1;
+            reg.h = (temp & 0x0F) == 0x00;
+            last_amount_cycles = 2;
+            break;
+        case 0x36://LD (HL),n
+            write_memory(gb, reg.HL, read_memory(gb, reg.PC));
+            reg.PC++;
+            last_amount_cycles = 3;
+            break;
+        case 0x37://SCF
+            reg.n = 0;
+            reg.h = 0;
+            reg.c = 1;
+            last_amount_cycles = 1;
+            break;
+        case 0x38://JR C,e
+            if (reg.c) {
+                reg.PC +=(int8_t)read_memory(gb, reg.PC++);
+                last_amount_cycles = 3;
+            } else {
+                reg.PC++;
+                last_amount_cycles = 2;
+            }
+            break;
+        case 0x39://ADD HL,SP
+            temp=reg.HL;
+            reg.HL += reg.SP;
+            reg.n = 0;
+            reg.h = (temp & 0xFFF) + (reg.SP & 0xFFF) > 0xFFF;
+            reg.c = reg.HL >0xFFFF;
+            last_amount_cycles = 2;
+            break;
+        case 0x3A://LD A,(HL-)
+            reg.A = read_memory(gb, reg.HL--);
+            last_amount_cycles = 2;
+            break;
+        case 0x3B://DEC SP
+            reg.SP--;
+            last_amount_cycles = 2;
+            break;
+        case 0x3C://INC A
+            reg.A++;
+            reg.z = (reg.A == 0);
+            reg.n = 0;
+            reg.h = ((reg.A & 0xF) < (reg.A-1 & 0xF));
+            last_amount_cycles = 1;
+            break;
+        case 0x3D://DEC A
+            reg.A--;
+            reg.z = reg.A == 0;
+            reg.n = 1;
+            reg.h = ((reg.A & 0xF) > (reg.A+1 & 0xF));
+            last_amount_cycles = 1;
+            break;
+        case 0x3E://LD A,n
+            reg.A = read_memory(gb, reg.PC);
+            reg.PC++;
+            last_amount_cycles = 2;
+            break;
+        case 0x3F://CCF
+            reg.n = 0;
+            reg.h = 0;
+            reg.c = !reg.c;
+            last_amount_cycles = 1;
+            break;
+        case 0x40 ... 0x45:case 0x47://LD B,B
+            reg.B=*regs[opcode&0x7];
+            last_amount_cycles = 1;
+            break;
+        case 0x46://LD B,(HL)
+            reg.B = read_memory(gb, reg.HL);
+            last_amount_cycles = 2;
+            break;
+        case 0x48 ... 0x4D:case 0x4F://LD C,B ... A
+            reg.C = *regs[opcode & 0x07];
+            last_amount_cycles = 1;
+            break;
+        case 0x4E://LD C,(HL)
+            reg.C = read_memory(gb, reg.HL);
+            last_amount_cycles = 2;
+            break;
+        case 0x50 ... 0x55:case 0x57://LD D,B .... LD D,A
+            reg.D=*regs[opcode&0x07];
+            last_amount_cycles = 1;
+            break;
+        case 0x56://LD D,(HL)
+            reg.D = read_memory(gb, reg.HL);
+            last_amount_cycles = 2;
+            break;
+        case 0x58 ... 0x5D: case 0x5F://LD E,B ... A
+            reg.E=*regs[opcode&0x07];
+            last_amount_cycles = 1;
+            break;
+        case 0x5E://LD E,(HL)
+            reg.E = read_memory(gb, reg.HL);
+            last_amount_cycles = 2;
+            break;
+        case 0x60 ... 0x65: case 0x67://LD H, B ... L A
+                reg.H=*regs[opcode & 0x07];
+                last_amount_cycles = 1;
+                break;
+        case 0x66://LD H,(HL)
+            reg.H = read_memory(gb, reg.HL);
+            last_amount_cycles = 2;
+            break;
+            case 0x68 ... 0x6D:case 0x6F://LD L, B, C, D, E, H, L, A
+                reg.L = *regs[opcode & 0x07];
+                last_amount_cycles = 1;
+                break;
+
+        case 0x6E://LD L,(HL)
+            reg.L = read_memory(gb, reg.HL);
+            last_amount_cycles = 2;
+            break;
+
+            case 0x70 ... 0x75: case 0x77://LD (HL),B
+            write_memory(gb, reg.HL, *regs[opcode & 0x07]);
+            last_amount_cycles = 2;
+            break;
+        case 0x76://HALT
+            //halted = true;     TODO : implement
+            break;
+        case 0x78 ... 0x7D:case 0x7F://LD A , B , C, D, E, H, L, A
+            reg.A = *regs[opcode & 0x07];
+            last_amount_cycles = 1;
+            break;
+        case 0x7E://LD A,(HL)
+            reg.A = read_memory(gb, reg.HL);
+            last_amount_cycles = 2;
+            break;
+        case 0x80 ... 0x85:
+        case 0x87://ADD A,B ... L ,A add to a reg b,c,d,e,h,l,a
+            temp = *regs[opcode & 0x07];
+            reg.A += temp;
+            reg.z = (reg.A == 0);
+            reg.n = 0;
+            reg.h = ((reg.A & 0x0F) < (temp & 0x0F));
+            reg.c = (reg.A < temp);
+            last_amount_cycles = 1;
+            break;
+        case 0x86://ADD A,(HL)
+            reg.A += read_memory(gb, reg.HL);
+            reg.z = (reg.A == 0);
+            reg.n = 0;
+            reg.h = ((reg.A & 0xF) < (read_memory(gb, reg.HL) & 0xF));
+            reg.c = (reg.A < read_memory(gb, reg.HL));
+            last_amount_cycles = 2;
+            break;
+
+        case 0x88 ... 0x8D:
+        case 0x8F://ADC A,B ... L ,A add to a reg b,c,d,e,h,l,a with carry
+            temp = *regs[opcode & 0x07];
+            reg.A += temp + reg.c;
+            reg.z = (reg.A == 0);
+            reg.n = 0;
+            reg.h = ((reg.A & 0x0F) < (temp & 0x0F) + reg.c);
+            reg.c = (reg.A < temp + reg.c);
+            last_amount_cycles = 1;
+            break;
+        case 0x8E://ADC A,(HL)
+            reg.A += read_memory(gb, reg.HL) + reg.c;
+            reg.z = (reg.A == 0);
+            reg.n = 0;
+            reg.h = ((reg.A & 0xF) < (read_memory(gb, reg.HL) & 0xF));
+            reg.c = (reg.A < read_memory(gb, reg.HL));
+            last_amount_cycles = 2;
+            break;
+
+        case 0x90 ... 0x95:
+        case 0x97://SUB B ... A subtract to A reg B,C,D,E,H,L,A
+            temp = *regs[opcode & 0x07];
+            reg.A -= temp;
+            reg.z = (reg.A == 0);
+            reg.n = 1;
+            reg.h = ((reg.A & 0xF) > (temp & 0xF));
+            reg.c = (reg.A > temp);
+            last_amount_cycles = 1;
+            break;
+        case 0x96://SUB (HL)
+            reg.A -= read_memory(gb, reg.HL);
+            temp = read_memory(gb, reg.HL);
+            reg.z = (reg.A == 0);
+            reg.n = 1;
+            reg.h = ((reg.A & 0xF) > (temp & 0xF));
+            reg.c = (reg.A > temp);
+            last_amount_cycles = 2;
+            break;
+        case 0x98 ... 0x9D:
+        case 0x9F://SBC A,B ... A subtract to A reg B,C,D,E,H,L,A
+            temp = *regs[opcode & 0x7];
+            reg.A -= temp + reg.c;
+            reg.z = (reg.A == 0);
+            reg.n = 1;
+            reg.h = ((reg.A & 0xF) > (temp & 0xF));
+            reg.c = ((reg.A + reg.c) > temp);
+            last_amount_cycles = 1;
+            break;
+        case 0x9E://SBC A,(HL)
+            reg.A -= read_memory(gb, reg.HL) + reg.c;
+            temp = read_memory(gb, reg.HL);
+            reg.z = (reg.A == 0);
+            reg.n = 1;
+            reg.h = ((reg.A & 0xF) > (temp & 0xF));
+            reg.c = ((reg.A + reg.c) > temp);
+            last_amount_cycles = 2;
+            break;
+        case 0xA0 ... 0xA5:
+        case 0xA7:// AND A,B ... A  and operation from B to A based on opcode
+            reg.A = reg.A & *regs[opcode & 0x7];
+            reg.z = (reg.A == 0);
+            reg.n = 0;
+            reg.h = 1;
+            reg.c = 0;
+            last_amount_cycles = 1;
+            break;
+        case 0xA6://AND A,(HL)
+            reg.A = reg.A & read_memory(gb, reg.HL);
+            reg.z = (reg.A == 0);
+            reg.n = 0;
+            reg.h = 1;
+            reg.c = 0;
+            last_amount_cycles = 2;
+            break;
+            case 0xA8 ... 0xAD: case 0xAF://XOR A,B ... A  and operation from B to A based on opcode
+            reg.A = reg.A ^ *regs[opcode & 0x7];
+            reg.z = (reg.A == 0);
+            reg.n = 0;
+            reg.h = 0;
+            reg.c = 0;
+            last_amount_cycles = 1;
+            break;
+        case 0xAE://XOR A,(HL)
+            reg.A = reg.A ^ read_memory(gb, reg.HL);
+            reg.z = (reg.A == 0);
+            reg.n = 0;
+            reg.h = 0;
+            reg.c = 0;
+            last_amount_cycles = 2;
+            break;
+        case 0xB0 ... 0xB5:case 0xB7://OR A,B ... A  and operation from B to A based on opcode
+            reg.A = reg.A | *regs[opcode & 0x7];
+            reg.z = (reg.A == 0);
+            reg.n = 0;
+            reg.h = 0;
+            reg.c = 0;
+            last_amount_cycles = 1;
+            break;
+        case 0xB6://OR A,(HL)
+            reg.A = reg.A | read_memory(gb, reg.HL);
+            reg.z = (reg.A == 0);
+            reg.n = 0;
+            reg.h = 0;
+            reg.c = 0;
+            last_amount_cycles = 2;
+            break;
+        case 0xB8 ... 0xBD:case 0xBF://CP A,B ... A  and operation from B to A based on opcode
+            temp = *regs[opcode & 0x7];
+            reg.z = (reg.A == temp);
+            reg.n = 1;
+            reg.h = ((reg.A & 0xF) > (temp & 0xF));
+            reg.c = (reg.A > temp);
+            last_amount_cycles = 1;
+            break;
+        case 0xBE://CP A,(HL)
+            temp = read_memory(gb, reg.HL);
+            reg.z = (reg.A == temp);
+            reg.n = 1;
+            reg.h = ((reg.A & 0xF) > (temp & 0xF));
+            reg.c = (reg.A > temp);
+            last_amount_cycles = 2;
+            break;
+        case 0xC0://RET NZ
+            if (!reg.z)
+            {
+                reg.PC= read_memory16(gb, reg.SP);
+                reg.SP += 2;
+                last_amount_cycles = 5;
+            }
+            else
+            {
+                last_amount_cycles = 2;
+            }
+            break;
+        case 0xC1://POP BC
+            reg.C = read_memory(gb, reg.SP + 1);
+            reg.B = read_memory(gb, reg.SP);
+            reg.SP += 2;
+            last_amount_cycles = 3;
+            break;
+        case 0xC2://JP NZ,nn
+            if (!reg.z)
+            {
+
+                reg.PC = read_memory16(gb, reg.PC);
+                last_amount_cycles = 4;
+            }
+            else
+            {
+                reg.PC += 2;
+                last_amount_cycles = 3;
+            }
+            break;
+        case 0xC3://JP nn
+            reg.PC = read_memory16(gb, reg.PC);
+            last_amount_cycles = 4;
+            break;
+        case 0xC4://CALL NZ,nn
+            if (!reg.z)
+            {
+                reg.SP -= 2;
+                temp16 = reg.PC + 2;
+                write_memory16(gb, reg.SP, &temp16);
+                reg.PC = read_memory16(gb, reg.PC);
+                last_amount_cycles = 6;
+            }
+            else
+            {
+                reg.PC += 2;
+                last_amount_cycles = 3;
+            }
+            break;
+        case 0xC5://PUSH BC
+            reg.SP -= 2;
+            write_memory16(gb, reg.SP, &reg.BC);
+            last_amount_cycles = 4;
+            break;
+        case 0xC6://ADD A,n
+            reg.A += read_memory(gb, reg.PC);
+            reg.z = (reg.A == 0);
+            reg.n = 0;
+            reg.h = ((reg.A & 0xF) > (read_memory(gb, reg.PC) & 0xF));
+            reg.c = ((reg.A + read_memory(gb, reg.PC)) > 0xFF);
+            reg.PC++;
+            last_amount_cycles = 2;
+            break;
+        case 0xC7://RST 0
+            reg.SP -= 2;
+            write_memory16(gb, reg.SP, &reg.PC);
+            reg.PC = 0;
+            last_amount_cycles = 4;
+            break;
+        case 0xC8://RET Z
+            if (reg.z)
+            {
+                reg.PC= read_memory16(gb, reg.SP);
+                reg.SP += 2;
+                last_amount_cycles = 5;
+            }
+            else
+            {
+                last_amount_cycles = 2;
+            }
+            break;
+        case 0xC9://RET
+            reg.PC= read_memory16(gb, reg.SP);
+            reg.SP += 2;
+            last_amount_cycles = 5;
+            break;
+        case 0xCA://JP Z,nn
+            if (reg.z)
+            {
+                reg.PC = read_memory16(gb, reg.PC);
+                last_amount_cycles = 4;
+            }
+            else
+            {
+                reg.PC += 2;
+                last_amount_cycles = 3;
+            }
+            break;
+        case 0xCB://CB prefix
+            //a switch statement for all the CB instructions
+            cb_opcode = read_memory(gb, reg.PC++);
+            switch (cb_opcode)
+            {
+                case 0x00 ... 0x05:case 0x07://RLC B ... B  rotate left operation from B to A based on cb_opcode
+                    *regs[cb_opcode & 0x7] = (*regs[cb_opcode & 0x7] << 1) | ((*regs[cb_opcode & 0x7] & 0x80) >> 7);
+                    reg.z = (*regs[cb_opcode & 0x7] == 0);
+                    reg.n = 0;
+                    reg.h = 0;
+                    reg.c = (*regs[cb_opcode & 0x7] & 0x80) >> 7;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x06://RLC (HL)
+                    write_memory(gb,  reg.HL, (read_memory(gb, reg.HL) << 1) | ((read_memory(gb, reg.HL) & 0x80) >> 7));
+                    reg.z = (read_memory(gb, reg.HL) == 0);
+                    reg.n = 0;
+                    reg.h = 0;
+                    reg.c = (read_memory(gb, reg.HL) & 0x80) >> 7;
+                    last_amount_cycles = 16;
+                    break;
+                case 0x08 ... 0x0D:case 0x0F://RRC B ... B  rotate right  operation from B to A based on cb_opcode
+                    *regs[cb_opcode & 0x7] = (*regs[cb_opcode & 0x7] >> 1) | ((*regs[cb_opcode & 0x7] & 0x01) << 7);
+                    reg.z = (*regs[cb_opcode & 0x7] == 0);
+                    reg.n = 0;
+                    reg.h = 0;
+                    reg.c = (*regs[cb_opcode & 0x7] & 0x01);
+                    last_amount_cycles = 2;
+                    break;
+                case 0x0E://RRC (HL)
+                    write_memory(gb,  reg.HL, (read_memory(gb, reg.HL) >> 1) | ((read_memory(gb, reg.HL) & 0x01) << 7));
+                    reg.z = (read_memory(gb, reg.HL) == 0);
+                    reg.n = 0;
+                    reg.h = 0;
+                    reg.c = (read_memory(gb, reg.HL) & 0x01);
+                    last_amount_cycles = 16;
+                    break;
+                case 0x10 ... 0x15:case 0x17://RL B ... B  rotate right through carry bit operation from B to A based on cb_opcode
+                    temp = (*regs[cb_opcode & 0x7] & 0x80) >> 7;
+                    *regs[cb_opcode & 0x7] = (*regs[cb_opcode & 0x7] << 1) | reg.c;
+                    reg.z = (*regs[cb_opcode & 0x7] == 0);
+                    reg.n = 0;
+                    reg.h = 0;
+                    reg.c = temp;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x16://RL (HL)
+                    temp = (read_memory(gb, reg.HL) & 0x80) >> 7;
+                    write_memory(gb,  reg.HL, (read_memory(gb, reg.HL) << 1) | reg.c);
+                    reg.c = temp;
+                    reg.z = (read_memory(gb, reg.HL) == 0);
+                    reg.n = 0;
+                    reg.h = 0;
+                    last_amount_cycles = 16;
+                    break;
+                case 0x18 ... 0x1D:case 0x1F://RR B ... B  rotate right through carry bit from B to A based on cb_opcode
+                    temp = (*regs[cb_opcode & 0x7] & 0x01);
+                    *regs[cb_opcode & 0x7] = (*regs[cb_opcode & 0x7] >> 1) | (reg.c << 7);
+                    reg.z = (*regs[cb_opcode & 0x7] == 0);
+                    reg.n = 0;
+                    reg.h = 0;
+                    reg.c = temp;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x1E://RR (HL)
+                    temp = (read_memory(gb, reg.HL) & 0x01);
+                    write_memory(gb,  reg.HL, (read_memory(gb, reg.HL) >> 1) | (reg.c << 7));
+                    reg.z = (read_memory(gb, reg.HL) == 0);
+                    reg.n = 0;
+                    reg.h = 0;
+                    reg.c = temp;
+                    last_amount_cycles = 16;
+                    break;
+                case 0x20 ... 0x25:case 0x27://SLA B ... B  and operation from B to A based on cb_opcode
+                    reg.c = (*regs[cb_opcode & 0x7] & 0x80) >> 7;
+                    *regs[cb_opcode & 0x7] = *regs[cb_opcode & 0x7] << 1;
+                    reg.z = (*regs[cb_opcode & 0x7] == 0);
+                    reg.n = 0;
+                    reg.h = 0;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x26://SLA (HL)
+                    reg.c = (read_memory(gb, reg.HL) & 0x80) >> 7;
+                    write_memory(gb,  reg.HL, read_memory(gb, reg.HL) << 1);
+                    reg.z = (read_memory(gb, reg.HL) == 0);
+                    reg.n = 0;
+                    reg.h = 0;
+                    last_amount_cycles = 16;
+                    break;
+                case 0x28 ... 0x2D:case 0x2F://SRA B ... B  Shift Right Arithmetic register from B to A based on cb_opcode
+                    reg.c = (*regs[cb_opcode & 0x7] & 0x01);
+                    *regs[cb_opcode & 0x7] = (*regs[cb_opcode & 0x7] >> 1);
+                    reg.z = (*regs[cb_opcode & 0x7] == 0);
+                    reg.n = 0;
+                    reg.h = 0;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x2E://SRA (HL)
+                    reg.c = (read_memory(gb, reg.HL) & 0x01);
+                    write_memory(gb,  reg.HL, read_memory(gb, reg.HL) >> 1);
+                    reg.z = (read_memory(gb, reg.HL) == 0);
+                    reg.n = 0;
+                    reg.h = 0;
+                    last_amount_cycles = 16;
+                    break;
+                case 0x30 ... 0x35:case 0x37://SWAP B ... A  Swap upper and lower nibbles of register r8 based on cb_opcode
+                    *regs[cb_opcode & 0x7] = ((temp & 0xF0) >> 4) | ((temp & 0x0F) << 4);
+                    reg.z = (*regs[cb_opcode & 0x7] == 0);
+                    reg.n = 0;
+                    reg.h = 0;
+                    reg.c = 0;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x36://SWAP (HL)
+                    temp = (read_memory(gb, reg.HL) & 0xF0) >> 4;
+                    write_memory(gb,  reg.HL, (read_memory(gb, reg.HL) & 0x0F) << 4 | temp);
+                    reg.z = (read_memory(gb, reg.HL) == 0);
+                    reg.n = 0;
+                    reg.h = 0;
+                    reg.c = 0;
+                    last_amount_cycles = 16;
+                    break;
+                case 0x38 ... 0x3D:case 0x3F://SRL B ... B  Shift Right Logical register r8 from B to A based on cb_opcode
+                    reg.c = (*regs[cb_opcode & 0x7] & 0x01);
+                    *regs[cb_opcode & 0x7] = *regs[cb_opcode & 0x7] >> 1;
+                    reg.z = (*regs[cb_opcode & 0x7] == 0);
+                    reg.n = 0;
+                    reg.h = 0;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x3E://SRL (HL)
+                    reg.c = (read_memory(gb, reg.HL) & 0x01);
+                    write_memory(gb,  reg.HL, read_memory(gb, reg.HL) >> 1);
+                    reg.z = (read_memory(gb, reg.HL) == 0);
+                    reg.n = 0;
+                    reg.h = 0;
+                    last_amount_cycles = 16;
+                    break;
+                case 0x40 ... 0x45:case 0x47://BIT 0, B ... A  Test bit 0 of register r8 based on cb_opcode
+                    reg.z = ((*regs[cb_opcode & 0x7] & 0x01) == 0);
+                    reg.n = 0;
+                    reg.h = 1;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x46://BIT 0, (HL)
+                    reg.z = ((read_memory(gb, reg.HL) & 0x01) == 0);
+                    reg.n = 0;
+                    reg.h = 1;
+                    last_amount_cycles = 16;
+                    break;
+                case 0x48 ... 0x4D:case 0x4F://BIT 1, B ... A  Test bit 1 of register r8 based on cb_opcode
+                    reg.z = ((*regs[cb_opcode & 0x7] & 0x02) == 0);
+                    reg.n = 0;
+                    reg.h = 1;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x4E://BIT 1, (HL)
+                    reg.z = ((read_memory(gb, reg.HL) & 0x02) == 0);
+                    reg.n = 0;
+                    reg.h = 1;
+                    last_amount_cycles = 16;
+                    break;
+                case 0x50 ... 0x55:case 0x57://BIT 2, B ... A  Test bit 2 of register r8 based on cb_opcode
+                    reg.z = ((*regs[cb_opcode & 0x7] & 0x04) == 0);
+                    reg.n = 0;
+                    reg.h = 1;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x56://BIT 2, (HL)
+                    reg.z = ((read_memory(gb, reg.HL) & 0x04) == 0);
+                    reg.n = 0;
+                    reg.h = 1;
+                    last_amount_cycles = 16;
+                    break;
+                case 0x58 ... 0x5D:case 0x5F://BIT 3, B ... A  Test bit 3 of register r8 based on cb_opcode
+                    reg.z = ((*regs[cb_opcode & 0x7] & 0x08) == 0);
+                    reg.n = 0;
+                    reg.h = 1;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x5E://BIT 3, (HL)
+                    reg.z = ((read_memory(gb, reg.HL) & 0x08) == 0);
+                    reg.n = 0;
+                    reg.h = 1;
+                    last_amount_cycles = 16;
+                    break;
+                case 0x60 ... 0x65:case 0x67://BIT 4, B ... A  Test bit 4 of register r8 based on cb_opcode
+                    reg.z = ((*regs[cb_opcode & 0x7] & 0x10) == 0);
+                    reg.n = 0;
+                    reg.h = 1;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x66://BIT 4, (HL)
+                    reg.z = ((read_memory(gb, reg.HL) & 0x10) == 0);
+                    reg.n = 0;
+                    reg.h = 1;
+                    last_amount_cycles = 16;
+                    break;
+                case 0x68 ... 0x6D:case 0x6F://BIT 5, B ... A  Test bit 5 of register r8 based on cb_opcode
+                    reg.z = ((*regs[cb_opcode & 0x7] & 0x20) == 0);
+                    reg.n = 0;
+                    reg.h = 1;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x6E://BIT 5, (HL)
+                    reg.z = ((read_memory(gb, reg.HL) & 0x20) == 0);
+                    reg.n = 0;
+                    reg.h = 1;
+                    last_amount_cycles = 16;
+                    break;
+                case 0x70 ... 0x75:case 0x77://BIT 6, B ... A  Test bit 6 of register r8 based on cb_opcode
+                    reg.z = ((*regs[cb_opcode & 0x7] & 0x40) == 0);
+                    reg.n = 0;
+                    reg.h = 1;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x76://BIT 6, (HL)
+                    reg.z = ((read_memory(gb, reg.HL) & 0x40) == 0);
+                    reg.n = 0;
+                    reg.h = 1;
+                    last_amount_cycles = 16;
+                    break;
+                case 0x78 ... 0x7D:case 0x7F://BIT 7, B ... A  Test bit 7 of register r8 based on cb_opcode
+                    reg.z = ((*regs[cb_opcode & 0x7] & 0x80) == 0);
+                    reg.n = 0;
+                    reg.h = 1;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x7E://BIT 7, (HL)
+                    reg.z = ((read_memory(gb, reg.HL) & 0x80) == 0);
+                    reg.n = 0;
+                    reg.h = 1;
+                    last_amount_cycles = 16;
+                    break;
+                case 0x80 ... 0x85:case 0x87://RES 0, B ... A  Reset bit 0 of register r8 based on cb_opcode
+                    *regs[cb_opcode & 0x7] &= 0xFE;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x86://RES 0, (HL)
+                    write_memory(gb, reg.HL, read_memory(gb, reg.HL) & 0xFE);
+                    last_amount_cycles = 16;
+                    break;
+                case 0x88 ... 0x8D:case 0x8F://RES 1, B ... A  Reset bit 1 of register r8 based on cb_opcode
+                    *regs[cb_opcode & 0x7] &= 0xFD;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x8E://RES 1, (HL)
+                    write_memory(gb, reg.HL, read_memory(gb, reg.HL) & 0xFD);
+                    last_amount_cycles = 16;
+                    break;
+                case 0x90 ... 0x95:case 0x97://RES 2, B ... A  Reset bit 2 of register r8 based on cb_opcode
+                    *regs[cb_opcode & 0x7] &= 0xFB;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x96://RES 2, (HL)
+                    write_memory(gb, reg.HL, read_memory(gb, reg.HL) & 0xFB);
+                    last_amount_cycles = 16;
+                    break;
+                case 0x98 ... 0x9D:case 0x9F://RES 3, B ... A  Reset bit 3 of register r8 based on cb_opcode
+                    *regs[cb_opcode & 0x7] &= 0xF7;
+                    last_amount_cycles = 2;
+                    break;
+                case 0x9E://RES 3, (HL)
+                    write_memory(gb, reg.HL, read_memory(gb, reg.HL) & 0xF7);
+                    last_amount_cycles = 16;
+                    break;
+                case 0xA0 ... 0xA5:case 0xA7://RES 4, B ... A  Reset bit 4 of register r8 based on cb_opcode
+                    *regs[cb_opcode & 0x7] &= 0xEF;
+                    last_amount_cycles = 2;
+                    break;
+                case 0xA6://RES 4, (HL)
+                    write_memory(gb, reg.HL, read_memory(gb, reg.HL) & 0xEF);
+                    last_amount_cycles = 16;
+                    break;
+                case 0xA8 ... 0xAD:case 0xAF://RES 5, B ... A  Reset bit 5 of register r8 based on cb_opcode
+                    *regs[cb_opcode & 0x7] &= 0xDF;
+                    last_amount_cycles = 2;
+                    break;
+                case 0xAE://RES 5, (HL)
+                    write_memory(gb, reg.HL, read_memory(gb, reg.HL) & 0xDF);
+                    last_amount_cycles = 16;
+                    break;
+                case 0xB0 ... 0xB5:case 0xB7://RES 6, B ... A  Reset bit 6 of register r8 based on cb_opcode
+                    *regs[cb_opcode & 0x7] &= 0xBF;
+                    last_amount_cycles = 2;
+                    break;
+                case 0xB6://RES 6, (HL)
+                    write_memory(gb, reg.HL, read_memory(gb, reg.HL) & 0xBF);
+                    last_amount_cycles = 16;
+                    break;
+                case 0xB8 ... 0xBD:case 0xBF://RES 7, B ... A  Reset bit 7 of register r8 based on cb_opcode
+                    *regs[cb_opcode & 0x7] &= 0x7F;
+                    last_amount_cycles = 2;
+                    break;
+                case 0xBE://RES 7, (HL)
+                    write_memory(gb, reg.HL, read_memory(gb, reg.HL) & 0x7F);
+                    last_amount_cycles = 16;
+                    break;
+                case 0xC0 ... 0xC5:case 0xC7://SET 0, B ... A  Set bit 0 of register r8 based on cb_opcode
+                    *regs[cb_opcode & 0x7] |= 0x01;
+                    last_amount_cycles = 2;
+                    break;
+                case 0xC6://SET 0, (HL)
+                    write_memory(gb, reg.HL, read_memory(gb, reg.HL) | 0x01);
+                    last_amount_cycles = 16;
+                    break;
+                case 0xC8 ... 0xCD:case 0xCF://SET 1, B ... A  Set bit 1 of register r8 based on cb_opcode
+                    *regs[cb_opcode & 0x7] |= 0x02;
+                    last_amount_cycles = 2;
+                    break;
+                case 0xCE://SET 1, (HL)
+                    write_memory(gb, reg.HL, read_memory(gb, reg.HL) | 0x02);
+                    last_amount_cycles = 16;
+                    break;
+                case 0xD0 ... 0xD5:case 0xD7://SET 2, B ... A  Set bit 2 of register r8 based on cb_opcode
+                    *regs[cb_opcode & 0x7] |= 0x04;
+                    last_amount_cycles = 2;
+                    break;
+                case 0xD6://SET 2, (HL)
+                    write_memory(gb, reg.HL, read_memory(gb, reg.HL) | 0x04);
+                    last_amount_cycles = 16;
+                    break;
+                case 0xD8 ... 0xDD:case 0xDF://SET 3, B ... A  Set bit 3 of register r8 based on cb_opcode
+                    *regs[cb_opcode & 0x7] |= 0x08;
+                    last_amount_cycles = 2;
+                    break;
+                case 0xDE://SET 3, (HL)
+                    write_memory(gb, reg.HL, read_memory(gb, reg.HL) | 0x08);
+                    last_amount_cycles = 16;
+                    break;
+                case 0xE0 ... 0xE5:case 0xE7://SET 4, B ... A  Set bit 4 of register r8 based on cb_opcode
+                    *regs[cb_opcode & 0x7] |= 0x10;
+                    last_amount_cycles = 2;
+                    break;
+                case 0xE6://SET 4, (HL)
+                    write_memory(gb, reg.HL, read_memory(gb, reg.HL) | 0x10);
+                    last_amount_cycles = 16;
+                    break;
+                case 0xE8 ... 0xED:case 0xEF://SET 5, B ... A  Set bit 5 of register r8 based on cb_opcode
+                    *regs[cb_opcode & 0x7] |= 0x20;
+                    last_amount_cycles = 2;
+                    break;
+                case 0xEE://SET 5, (HL)
+                    write_memory(gb, reg.HL, read_memory(gb, reg.HL) | 0x20);
+                    last_amount_cycles = 16;
+                    break;
+                case 0xF0 ... 0xF5:case 0xF7://SET 6, B ... A  Set bit 6 of register r8 based on cb_opcode
+                    *regs[cb_opcode & 0x7] |= 0x40;
+                    last_amount_cycles = 2;
+                    break;
+                case 0xF6://SET 6, (HL)
+                    write_memory(gb, reg.HL, read_memory(gb, reg.HL) | 0x40);
+                    last_amount_cycles = 16;
+                    break;
+                case 0xF8 ... 0xFD:case 0xFF://SET 7, B ... A  Set bit 7 of register r8 based on cb_opcode
+                    *regs[cb_opcode & 0x7] |= 0x80;
+                    last_amount_cycles = 2;
+                    break;
+                case 0xFE://SET 7, (HL)
+                    write_memory(gb, reg.HL, read_memory(gb, reg.HL) | 0x80);
+                    last_amount_cycles = 16;
+                    break;
+                default:
+
+
+                    if (gb->verbose)
+                        printf("Unknown opcode: %02X %02X at PC %04X", opcode,cb_opcode, reg.PC);
+                    gb->wannadie = 1;
+                    break;
+
+            }
+            break;
+        case 0xCC://CALL Z, nn TODO implement
+            reg.PC += 2;
+            if (reg.z) {
+                last_amount_cycles = 24;
+                reg.SP -= 2;
+                write_memory16(gb, reg.SP, &reg.PC);
+                reg.PC = read_memory16(gb, reg.PC);
+
+            }
+            else {
+                last_amount_cycles = 12;
+                reg.PC += 2;
+            }
+            break;
+        case 0xCD://CALL nn
+            reg.PC += 2;
+            reg.SP -= 2;
+            write_memory16(gb, reg.SP, &reg.PC);
+            reg.PC = read_memory16(gb, reg.PC-2);
+            last_amount_cycles = 24;
+            break;
+        case 0xCE://ADC A, n
+            reg.A += read_memory(gb, reg.PC) + reg.c;
+            reg.PC++;
+            reg.z = (reg.A == 0);
+            reg.n = 0;
+            reg.h = ((reg.A & 0xF) > (read_memory16(gb, reg.PC-1) & 0xF));
+            reg.c = (reg.A > read_memory16(gb, reg.PC-1));
+            last_amount_cycles = 8;
+            break;
+        case 0xCF://RST 8
+            reg.SP -= 2;
+            write_memory16(gb, reg.SP, &reg.PC);
+            reg.PC = 0x08;
+            last_amount_cycles = 32;
+            break;
+        case 0xD0://RET NC
+            if (!reg.c) {
+                reg.PC = read_memory16(gb, reg.SP);
+                reg.SP += 2;
+                last_amount_cycles = 20;
+            }
+            else {
+                reg.PC += 2;
+                last_amount_cycles = 8;
+            }
+            break;
+        case 0xD1://POP DE
+            reg.DE = read_memory16(gb, reg.SP);
+            reg.SP += 2;
+            last_amount_cycles = 12;
+            break;
+        case 0xD2://JP NC, nn
+            if (!reg.c) {
+                reg.PC = read_memory16(gb, reg.PC);
+                last_amount_cycles = 16;
+            } else {
+                reg.PC += 2;
+                last_amount_cycles = 12;
+            }
+            break;
+        case 0xD3://
+            break;
+        case 0xD4://CALL NC, nn TODO test
+            if (!reg.c) {
+                reg.PC += 2;
+                reg.SP -= 2;
+                write_memory16(gb, reg.SP, &reg.PC);
+                reg.PC = read_memory16(gb, reg.PC-2);
+                last_amount_cycles = 24;
+            } else {
+                reg.PC += 2;
+                last_amount_cycles = 12;
+            }
+            break;
+        case 0xD5://PUSH DE
+            reg.SP -= 2;
+            write_memory16(gb, reg.SP, &reg.DE);
+            last_amount_cycles = 16;
+            break;
+        case 0xD6://SUB n
+            reg.A -= read_memory(gb, reg.PC);
+            reg.PC++;
+            reg.z = (reg.A == 0);
+            reg.n = 1;
+            reg.h = ((reg.A & 0xF) < (read_memory16(gb, reg.PC-1) & 0xF));
+            reg.c = (reg.A < read_memory16(gb, reg.PC-1));
+            last_amount_cycles = 8;
+            break;
+        case 0xD7://RST 10
+            reg.SP -= 2;
+            write_memory16(gb, reg.SP, &reg.PC);
+            reg.PC = 0x10;
+            last_amount_cycles = 4;
+            break;
+        case 0xD8://RET C
+            if (reg.c) {
+                reg.PC = read_memory16(gb, reg.SP);
+                reg.SP += 2;
+                last_amount_cycles = 20;
+            }
+            else {
+                reg.PC += 2;
+                last_amount_cycles = 8;
+            }
+            break;
+        case 0xD9://RETI
+            reg.PC = read_memory16(gb, reg.SP);
+            reg.SP += 2;
+            last_amount_cycles = 16;
+            //set ime
+            reg.ime = 1;
+            break;
+        case 0xDA://JP C, nn
+            if (reg.c) {
+                reg.PC = read_memory16(gb, reg.PC);
+                last_amount_cycles = 16;
+            } else {
+                reg.PC += 2;
+                last_amount_cycles = 12;
+            }
+            break;
+        case 0xDB://
+            break;
+        case 0xDC://CALL C, nn
+            if (reg.c) {
+                reg.SP -= 2;
+                temp16 = reg.PC+2;
+                write_memory16(gb, reg.SP, &temp16);
+                reg.PC = read_memory16(gb, reg.PC);
+                last_amount_cycles = 24;
+            } else {
+                reg.PC += 2;
+                last_amount_cycles = 12;
+            }
+            break;
+        case 0xDD://
+            break;
+        case 0xDE://SBC A, n
+            reg.A -= read_memory(gb, reg.PC) + reg.c;
+            reg.PC++;
+            reg.z = (reg.A == 0);
+            reg.n = 1;
+            reg.h = ((reg.A & 0xF) < (read_memory16(gb, reg.PC-1) & 0xF));
+            reg.c = (reg.A < read_memory16(gb, reg.PC-1));
+            last_amount_cycles = 8;
+            break;
+        case 0xDF://RST 18
+            reg.SP -= 2;
+            write_memory16(gb, reg.SP, &reg.PC);
+            reg.PC = 0x18;
+            last_amount_cycles = 4;
+            break;
+        case 0xE0://LDH (n), A
+            write_memory(gb, read_memory(gb, reg.PC++) + 0xFF00, reg.A);
+            last_amount_cycles = 12;
+            break;
+        case 0xE1://POP HL
+            reg.HL = read_memory16(gb, reg.SP);
+            reg.SP += 2;
+            last_amount_cycles = 12;
+            break;
+        case 0xE2://LDH (C), A
+            write_memory(gb, reg.C + 0xFF00, reg.A);
+            last_amount_cycles = 8;
+            break;
+        case 0xE3://
+            break;
+        case 0xE4://
+            break;
+        case 0xE5://PUSH HL
+            reg.SP -= 2;
+            write_memory16(gb, reg.SP, &reg.HL);
+            last_amount_cycles = 16;
+            break;
+        case 0xE6://AND n
+            reg.A &= read_memory(gb, reg.PC);
+            reg.PC++;
+            reg.z = (reg.A == 0);
+            reg.n = 0;
+            reg.h = 1;
+            reg.c = 0;
+            last_amount_cycles = 8;
+            break;
+        case 0xE7://RST 20
+            reg.SP -= 2;
+            write_memory16(gb, reg.SP, &reg.PC);
+            reg.PC = 0x20;
+            last_amount_cycles = 4;
+            break;
+        case 0xE8://ADD SP, n
+            reg.SP += read_memory(gb, reg.PC++);
+            reg.z = 0;
+            reg.n = 0;
+
+            reg.h = ((reg.SP & 0xFFFF) + (read_memory(gb, reg.PC-1) & 0xFFFF) > 0xFFFF);
+            reg.c = reg.SP > 0xFFFF;
+            last_amount_cycles = 16;
+            break;
+        case 0xE9://JP (HL)
+            reg.PC = reg.HL;
+            last_amount_cycles = 4;
+            break;
+        case 0xEA://LD (nn), A
+            write_memory(gb, read_memory16(gb, reg.PC), reg.A);
+            reg.PC += 2;
+            last_amount_cycles = 16;
+            break;
+        case 0xEB://
+            break;
+        case 0xEC://
+            break;
+        case 0xED://
+            break;
+        case 0xEE://XOR n
+            reg.A ^= read_memory(gb, reg.PC);
+            reg.PC++;
+            reg.z = (reg.A == 0);
+            reg.n = 0;
+            reg.h = 0;
+            reg.c = 0;
+            last_amount_cycles = 8;
+            break;
+        case 0xEF://RST 28
+            reg.SP -= 2;
+            write_memory16(gb, reg.SP, &reg.PC);
+            reg.PC = 0x28;
+            last_amount_cycles = 4;
+            break;
+        case 0xF0://LDH A, (n)
+            reg.A = read_memory(gb, 0xFF00 + read_memory(gb, reg.PC));
+            reg.PC++;
+            last_amount_cycles = 12;
+            break;
+        case 0xF1://POP AF
+            reg.AF = read_memory16(gb, reg.SP);
+            reg.unused=0;
+            reg.SP += 2;
+            last_amount_cycles = 12;
+            break;
+        case 0xF2://LDH A, (C)
+            reg.A = read_memory(gb, 0xFF00 + reg.C);
+            last_amount_cycles = 8;
+            break;
+        case 0xF3://DI
+        //clear ime from memory yet to implement interupts
+            reg.ime = 0;
+            last_amount_cycles = 4;
+            break;
+        case 0xF4://
+            break;
+        case 0xF5://PUSH AF
+            reg.SP -= 2;
+            write_memory16(gb, reg.SP, &reg.AF);
+            last_amount_cycles = 16;
+            break;
+        case 0xF6://OR n
+            reg.A |= read_memory(gb, reg.PC);
+            reg.PC++;
+            reg.z = (reg.A == 0);
+            reg.n = 0;
+            reg.h = 0;
+            reg.c = 0;
+            last_amount_cycles = 8;
+            break;
+        case 0xF7://RST 30
+            reg.SP -= 2;
+            write_memory16(gb, reg.SP, &reg.PC);
+            reg.PC = 0x30;
+            last_amount_cycles = 4;
+            break;
+        case 0xF8://LD HL, SP+n
+            reg.HL = reg.SP + read_memory(gb, reg.PC++);
+            reg.z = 0;
+            reg.n = 0;
+            reg.h = ((reg.HL & 0xFFFF) + (read_memory(gb, reg.PC-1) & 0xFFFF) > 0xFFFF);
+            reg.c = reg.HL > 0xFFFF;
+            last_amount_cycles = 12;
+            break;
+        case 0xF9://LD SP, HL
+            reg.SP = reg.HL;
+            last_amount_cycles = 8;
+            break;
+        case 0xFA://LD A, (nn)
+            reg.A = read_memory(gb, read_memory16(gb, reg.PC));
+            reg.PC += 2;
+            last_amount_cycles = 16;
+            break;
+        case 0xFB://EI
+            reg.ime = 1;
+            last_amount_cycles = 4;
+            break;
+        case 0xFC://
+            break;
+        case 0xFD://
+            break;
+        case 0xFE://CP n
+            temp=reg.A-read_memory(gb, reg.PC);
+            reg.PC++;
+            reg.z = (temp == 0);
+            reg.n = 1;
+            reg.h =( (int)reg.A- read_memory(gb, reg.PC-1))<0;
+            reg.c = (temp < read_memory(gb, reg.PC-1));
+            last_amount_cycles = 8;
+            break;
+        case 0xFF://RST 38
+            reg.SP -= 2;
+            write_memory16(gb, reg.SP, &reg.PC);
+            reg.PC = 0x38;
+            last_amount_cycles = 4;
+            break;
+
+
+
+
+
+
+
+
+            //TODO check flag on inc and dec add and sub
+        default:
+            if (gb->verbose)
+                printf("Unknown opcode: %02X\nat PC %04X", opcode, reg.PC-1);
+            gb->wannadie = 1;
+            break;
+    }
+}}
+
+
+
+
+
+
+
+
+//vblank
+void vblank_interrupt(gameboy *gb){
+    registers &reg = gb->reg;
+    if(reg.ime){
+
+        if (gb->verbose)
+            printf("vblank success\n");
+        reg.ime = 0;
+        reg.SP -= 2;
+        write_memory16(gb, reg.SP, &reg.PC);
+        reg.PC = 0x40;
+    }
+}
+
+//write the pc of the next instruction to the trace log, banked addresses are written as rom offsets
+void trace_pc(gameboy *gb, FILE *fp) {
+    if(gb->reg.PC>0x4000&&gb->reg.PC<0x8000){
+        fprintf(fp, " 0%04X\n", gb->reg.PC-0x4000+gb->offset);
+    } else{
+        fprintf(fp, "0%04X\n", gb->reg.PC);
+    }
+}
+
+//execute one instruction, returns 1 when the frame is over and end_frame has to be called
+int step_instruction(gameboy *gb) {
+    cpu_step(gb, read_memory(gb, gb->reg.PC));
+    gb->frame_counter -= gb->last_amount_cycles;
+    gb->total_cycles += gb->last_amount_cycles;
+    gb->total_instructions++;
+    return gb->frame_counter <= 0;
+}
+
+//the lcd is not emulated yet, LCDC and STAT are forced after every instruction
+void lcd_update(gameboy *gb) {
+    write_memory(gb, 0xFF40,0x70);
+    write_memory(gb, 0xFF41,0x93);
+}
+
+//vblank: draw the frame, raise the interrupt and latch vram, oam and the ppu registers for the next frame
+void end_frame(gameboy *gb, int draw) {
+    if (draw)
+        render(gb);
+    gb->frame_counter += FRAME_CYCLES;
+    vblank_interrupt(gb);
+    latch_ppu(gb);
+}
+
+//run until the end of the current frame
+void run_frame(gameboy *gb, int draw) {
+    while (!step_instruction(gb))
+        lcd_update(gb);
+    end_frame(gb, draw);
+    lcd_update(gb);
+}
+
+
+//flag to string
+
+
+
+int reg_to_string(gameboy *gb, char *string, size_t size) {
+    registers &reg = gb->reg;
+    return snprintf(string, size, "AF: %04X BC: %04X DE: %04X HL: %04X SP: %04X PC: %04X  z:%d c:%d n:%d h:%d", reg.AF, reg.BC, reg.DE, reg.HL, reg.SP, reg.PC, reg.z, reg.c, reg.n, reg.h);
+}
+//return reg and opcode to string
+int regop_to_string(gameboy *gb, char *string, size_t size) {
+    int len = snprintf(string, size, "opcode %02X ", read_memory(gb, gb->reg.PC));
+    return len + reg_to_string(gb, string + len, size - len);
+}
@@ -0,0 +1,432 @@
+#ifndef GB_H
+#define GB_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <atomic>
+#include <immintrin.h>
+
+
+
+// PPU register indexes
+#define PPU_LCDC    0x0
+#define PPU_STAT    0x1
+#define PPU_SCY     0x2
+#define PPU_SCX     0x3
+#define PPU_LY      0x4
+#define PPU_LYC     0x5
+#define PPU_BGP     0x7
+#define PPU_OBP0    0x8
+#define PPU_OBP1    0x9
+#define PPU_WY      0xa
+#define PPU_WX      0xb
+
+// LCDC masks
+#define LCDC_SWITCH 0b10000000
+#define LCDC_WNDTMS 0b01000000
+#define LCDC_WNDSWI 0b00100000
+#define LCDC_BGWTSS 0b00010000
+#define LCDC_BGWTMS 0b00001000
+#define LCDC_SPSIZE 0b00000100
+#define LCDC_SPDISP 0b00000010
+#define LCDC_BGWSWI 0b00000001
+
+#define HDMA1 0xFF51
+#define HDMA2 0xFF52
+#define HDMA3 0xFF53
+#define HDMA4 0xFF54
+#define HDMA5 0xFF55
+#define VBK 0xFF4F
+#define KEY1 0xFF4D
+#define RP 0xFF56
+#define OPRI 0xFF68
+#define SVBK 0xFF70
+
+//memory map
+#define ROM0 0x0000
+#define ROM1 0x4000
+#define VRAM 0x8000
+#define ERAM 0xA000
+#define WRAM 0xC000
+#define OAM 0xFE00
+#define HRAM 0xFF80
+
+
+//VRAM Tile Data
+#define VRAM_TILE0 0x8000
+#define VRAM_TILE1 0x8800
+
+//VRAM Tile Map
+#define VRAM_MAP0 0x9800
+#define VRAM_MAP1 0x9C00
+
+//IO Ranges
+#define Control 0xFF00
+#define Comunication 0xFF01
+#define Timer 0xFF01
+#define  Sound 0xFF10
+#define Waveform_Ram 0xFF30
+#define LCD_Control 0xFF40
+#define VRAM_Bank 0xFF4F
+#define disable_boot 0xFF50
+#define VRAM_DMA 0xFF51
+#define Palettes 0xFF68
+#define WRAM_Bank 0xFF70
+//LCD Position and Scrolling
+#define SCY 0xFF42 //Scroll Y
+#define SCX 0xFF43 //Scroll X
+#define LY 0xFF44 //current line
+#define LYC 0xFF45 // if equal to LY then the "LYC=LY" flag in the STAT register is set amd STAT interrupt is triggered
+#define WY 0xFF4A //Window Y
+#define WX 0xFF4B //Window X
+
+typedef struct cartridge_header {
+    char title[16];
+    uint8_t logo[48];
+    uint8_t type;
+    uint8_t rom_size;
+    uint8_t ram_size;
+    uint8_t destination_code;
+    uint8_t old_license_code;
+    uint8_t mask_rom_version;
+    uint8_t header_checksum;
+    uint8_t global_checksum[2];
+} cartridge_header;
+
+//LCD Control
+#define LCDC 0xFF40
+typedef struct lcdc_reg {
+    uint8_t LCD_enable: 1; //controls the LCD and PPU if 0 both will be off
+    uint8_t Window_tile_map: 1; //0 = $9800-$9BFF, 1 = $9C00-$9FFF controls with bg map the window uses for rendering
+    uint8_t Window_enable: 1; // controls if the windows shall be displayed
+    uint8_t BG_and_Window_tile_data: 1; //0 = $8800-$97FF, 1 = $8000-$8FFF controls which tile data is used for the background and window
+    uint8_t BG_tile_map: 1; //0 = $9800-$9BFF, 1 = $9C00-$9FFF controls which tile map is used for the background
+    uint8_t OBJ_enable: 1;
+    uint8_t OBJ_size: 1;
+    uint8_t BG_and_Window_tile_map: 1;
+
+
+} lcdc_reg;
+//LCD Status
+#define STAT 0xFF41
+typedef struct stat_reg {
+    union {
+        struct {
+            uint8_t mode_7: 1;
+            uint8_t LYC_LC_int_source: 1;
+            uint8_t mode2_OAM_Stat_int_source: 1;
+            uint8_t mode_1_VBlank_Stat_int_source: 1;
+            uint8_t mode_0_HBlank_Stat_interrupt_source: 1;
+            uint8_t LYC_LY_coincidence_flag: 1;
+            uint8_t mode_flag: 2;
+
+        };
+        uint8_t value;
+    };
+
+} stat_reg;
+
+#define pixel_width 160
+#define pixel_height 144
+#define pixel_size pixel_width*pixel_height
+//palettes
+#define BG_palette 0xFF47
+#define OBJ_palette0 0xFF48
+#define OBJ_palette1 0xFF49
+//Timer and Divider Register
+#define DIV 0xFF04 //increment at 16384Hz
+#define TIMA 0xFF05 //timer counter incremented at the rate specified by TAC
+#define TMA 0xFF06 //timer modulo when TIMA overflows it is set to value specified in this register
+#define TAC 0xFF07 //controls the timer speed bits 0-1 control the speed of the timer, bit 2 is the timer enable 00 = clock/1024, 01 = clock/16, 10 = clock/64, 11 = clock/256
+//Interrupts
+#define IF 0xFF0F //interrupt flag bit 0 = VBlank, 1 = LCD STAT, 2 = timer, 3 = serial, 4 = joypad
+#define IE 0xFFFF //interrupt enable bit 0 = VBlank, 1 = LCD STAT, 2 = timer, 3 = serial, 4 = joypad
+
+struct sprite{
+    union {
+        struct {
+            uint8_t y;
+            uint8_t x;
+            uint8_t tile;
+            uint8_t attr;
+        };
+        uint32_t raw;
+    };
+};
+
+//registers
+typedef struct registers {
+    union {
+        struct {
+
+            union {
+                struct {
+                    uint8_t unused: 4;
+                    uint8_t c: 1;
+                    uint8_t h: 1;
+                    uint8_t n: 1;
+                    uint8_t z: 1;
+
+                };
+
+                uint8_t F;
+            };
+            uint8_t A;
+        };
+        unsigned short AF;
+    };
+
+    union {
+        struct {
+            uint8_t C;
+            uint8_t B;
+        };
+        uint16_t BC;
+    };
+
+    union {
+        struct {
+            uint8_t E;
+            uint8_t D;
+        };
+        uint16_t DE;
+    };
+
+    union {
+        struct {
+            uint8_t L;
+            uint8_t H;
+        };
+        uint16_t HL;
+    };
+
+    uint16_t SP;
+    uint16_t PC;
+    //ime
+    uint8_t ime:1;
+
+} registers;
+
+
+
+typedef struct bank_number {
+    union {
+        struct {
+            uint8_t bank: 5;
+            uint8_t unused: 3;
+        };
+        uint8_t value;
+    };
+} bank_number;
+
+//rom, read only once loaded so one image can be shared by any number of instances
+//the buffer covers at least ROM_MIN_SIZE so every 5 bit bank number maps inside it
+#define ROM_MIN_SIZE 0x80000
+typedef struct rom {
+    uint8_t *buffer;
+    size_t size;
+    //buffer comes from map_rom_file
+    uint8_t mapped;
+} rom;
+
+//cpu cycles between two vblanks
+#define FRAME_CYCLES 65208
+//cpu cycles per second
+#define CPU_CLOCK 4194304
+
+//joypad buttons, 1 = pressed
+#define JOYPAD_RIGHT  0x01
+#define JOYPAD_LEFT   0x02
+#define JOYPAD_UP     0x04
+#define JOYPAD_DOWN   0x08
+#define JOYPAD_A      0x10
+#define JOYPAD_B      0x20
+#define JOYPAD_SELECT 0x40
+#define JOYPAD_START  0x80
+
+//rendered frame size, the whole 256x256 background map is drawn
+#define screen_width 256
+#define screen_height 256
+
+//pixel formats of a render target
+enum pixel_format {
+    PIXEL_INDEX8,  //one palette index per byte
+    PIXEL_GRAY8,   //one gray level per byte
+    PIXEL_PACKED2, //four palette indexes per byte, the first pixel in the two low bits
+    PIXEL_RGBA32   //r g b a bytes
+};
+
+//where render writes, every scanline is converted and stored as soon as it is drawn
+typedef struct render_target {
+    uint8_t *pixels;
+    //bytes from one row to the next, 0 for rows back to back
+    ptrdiff_t stride;
+    uint8_t format;
+    //1 or 2, 2 halves both sides: nearest pixel for the index formats, 2x2 average for gray and rgba
+    uint8_t downscale;
+    //rectangle of the 256x256 frame, width and height 0 go to the edge
+    uint8_t x, y;
+    uint16_t width, height;
+    //color of every palette index for PIXEL_RGBA32 with r in the first byte, NULL for default_rgba
+    const uint32_t *palette;
+} render_target;
+
+extern const uint8_t default_gray[4];
+extern const uint32_t default_rgba[4];
+
+//bump allocator for per frame scratch memory
+typedef struct arena {
+    uint8_t *base;
+    size_t size;
+    size_t used;
+} arena;
+#define FRAME_ARENA_SIZE 0x24000
+
+//memory map, the address space is split in 4 KiB pages
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+#define PAGE_COUNT (0x10000 >> PAGE_SHIFT)
+
+//writes are tracked in 256 byte blocks for the state hash (statehash.h)
+#define HASH_BLOCK_SHIFT 8
+#define HASH_BLOCK_SIZE (1 << HASH_BLOCK_SHIFT)
+#define HASH_BLOCKS (0x10000 >> HASH_BLOCK_SHIFT)
+
+//read only blocks shared by forked instances, allocated 64 byte aligned by share_alloc, the reference count has
+//the cache line before the data to itself
+typedef struct alignas(64) shared_block {
+    std::atomic<uint32_t> refs;
+} shared_block;
+
+//whole machine state of one console, instances share the read only rom and the pages of a fork
+//the hot cpu state is in the first cache line, the page tables in the next four and the dirty blocks after them
+typedef struct alignas(64) gameboy {
+    registers reg;
+    uint8_t joypad;
+    //print debug messages
+    uint8_t verbose;
+    unsigned int last_amount_cycles;
+    //cycles left in the current frame
+    int frame_counter;
+    //rom offset of the selected bank as printed in the trace
+    int offset;
+    int wannadie;
+    uint64_t total_cycles;
+    uint64_t total_instructions;
+    //rom offset mapped at 0x4000
+    uint32_t bank_address;
+    //bit n: page n of mem is a shared block, it is copied back to memory before the first write
+    uint16_t shared_pages;
+    //vram is a shared block
+    uint8_t vram_shared;
+    //the state hash is kept (statehash.h), writes mark their block in dirty
+    uint8_t hashing;
+
+    //page table for reads: 0x4000-0x7FFF is the selected rom bank, everything else is mem
+    alignas(64) uint8_t *page[PAGE_COUNT];
+    //page table for writes: the page of memory, or the shared block it is forked from
+    alignas(64) uint8_t *mem[PAGE_COUNT];
+    //1 for the blocks written since their hash was taken, a plain store per write and no read
+    alignas(64) uint8_t dirty[HASH_BLOCKS];
+    //sum of the block hashes, and of the vram blocks when they were last latched
+    uint64_t memory_hash;
+    uint64_t vram_hash;
+    //vram_hash matches vram
+    uint8_t vram_hashed;
+
+    const rom *cart;
+    cartridge_header header;
+    uint16_t breakpoint;
+    //copies latched at vblank for the ppu
+    uint8_t ppu_registers[0xc];
+    uint8_t oam[0xA0];
+    //latched vram, vram_home or a shared block
+    uint8_t *vram;
+    //render scratch, allocated with the instance
+    arena scratch;
+    //frames are drawn here, NULL for framebuffer
+    const render_target *output;
+
+    alignas(64) uint64_t block_hash[HASH_BLOCKS];
+    //own pages, mem points here unless a page is shared
+    alignas(64) uint8_t memory[0x10000];
+    alignas(64) uint8_t vram_home[0x2000];
+    //last rendered frame when output is NULL, one palette index per pixel
+    alignas(64) uint8_t framebuffer[screen_height][screen_width];
+} gameboy;
+
+//instances
+gameboy *create_gameboy();
+void destroy_gameboy(gameboy *gb);
+//child becomes a copy of parent that shares its pages until either of them writes one
+int fork_gameboy(gameboy *parent, gameboy *child);
+//move every page of gb to shared blocks so it can be a reset snapshot, it must not run after, -1 if out of memory
+int freeze_gameboy(gameboy *gb);
+//bring gb back to the frozen snapshot, only the pages written since the last reset are remapped and none is
+//copied, snapshot is only read so any number of threads can reset from it, -1 if it is not frozen
+int reset_gameboy(const gameboy *snapshot, gameboy *gb);
+
+//shared blocks
+uint8_t *share_alloc(size_t size);
+void share_ref(uint8_t *data);
+void share_release(uint8_t *data);
+//give up every shared block and go back to the own pages, which are not filled in
+void release_shared(gameboy *gb);
+//copy page n of a fork back to memory
+void unshare_page(gameboy *gb, int n);
+//the state hash is rebuilt from scratch by the next state_hash, after memory is changed behind write_memory
+void forget_state_hash(gameboy *gb);
+
+//arena
+void *arena_alloc(arena *a, size_t size);
+void arena_reset(arena *a);
+
+//ppu
+struct sprite get_sprite(gameboy *gb, uint8_t index);
+void get_sprites(gameboy *gb, sprite *sprites);
+uint8_t draw_sprite(gameboy *gb, uint8_t x, uint8_t y, uint8_t tile_n, uint8_t priority, int size, int xf, int yf);
+uint8_t draw_window_pixel(gameboy *gb, uint8_t y, uint8_t x);
+uint8_t draw_pixel(gameboy *gb, uint8_t y, uint8_t x);
+void render(gameboy *gb);
+void render_to(gameboy *gb, const render_target *t);
+//bytes of a tightly packed frame of t, row_bytes gets the bytes of one row if not NULL
+size_t render_target_size(const render_target *t, size_t *row_bytes);
+void latch_ppu(gameboy *gb);
+
+//memory
+uint8_t read_memory(gameboy *gb, uint16_t address);
+uint16_t read_memory16(gameboy *gb, uint16_t address);
+void write_memory16(gameboy *gb, uint16_t address, uint16_t *value);
+void write_memory(gameboy *gb, uint16_t address, uint8_t value);
+void mem_init(gameboy *gb);
+void reg_init(gameboy *gb);
+int load_rom_file(rom *r, const char *path);
+int load_rom_buffer(rom *r, const uint8_t *data, size_t size);
+int map_rom_file(rom *r, const char *path);
+void free_rom(rom *r);
+void load_header(gameboy *gb);
+void machine_init(gameboy *gb, const rom *r);
+uint8_t *load_input(const char *path, size_t *length);
+void print_cartridge_header(gameboy *gb);
+void map_rom_bank(gameboy *gb, uint32_t bank_address);
+void switch_rom_bank(gameboy *gb, bank_number bank);
+void write_to_rom_register(gameboy *gb, uint16_t address, uint8_t value);
+uint8_t joypad_register(gameboy *gb, uint8_t select);
+void set_joypad(gameboy *gb, uint8_t buttons);
+
+//cpu
+void cpu_step(gameboy *gb, uint8_t opcode);
+void vblank_interrupt(gameboy *gb);
+void trace_pc(gameboy *gb, FILE *fp);
+int step_instruction(gameboy *gb);
+void lcd_update(gameboy *gb);
+void end_frame(gameboy *gb, int draw);
+void run_frame(gameboy *gb, int draw);
+//write the registers to string, return the length like snprintf
+int reg_to_string(gameboy *gb, char *string, size_t size);
+int regop_to_string(gameboy *gb, char *string, size_t size);
+
+#endif //GB_H
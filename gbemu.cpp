@@ -0,0 +1,255 @@
+#include <new>
+#include "gb.h"
+#include "gbemu.h"
+#include "savestate.h"
+#include "statestore.h"
+#include "statehash.h"
+
+//c abi wrapper, one handle owns one instance and its own copy of the rom
+
+static_assert(GBEMU_FRAME_WIDTH == screen_width && GBEMU_FRAME_HEIGHT == screen_height, "framebuffer layout");
+static_assert(GBEMU_FORMAT_PACKED2 == PIXEL_PACKED2 && GBEMU_FORMAT_RGBA32 == PIXEL_RGBA32, "pixel format");
+static_assert(JOYPAD_START == GBEMU_START && JOYPAD_RIGHT == GBEMU_RIGHT, "joypad mask");
+
+struct gbemu {
+    gameboy *gb;
+    rom cart;
+    int draw;
+    uint64_t frames;
+    render_target output;
+    //frozen instance gbemu_reset goes back to, NULL to power cycle
+    gameboy *reset_state;
+};
+
+//checked copy of an output descriptor, also used by the vector env
+int output_to_target(const gbemu_output *output, render_target *t) {
+    if (output->format > GBEMU_FORMAT_RGBA32 || output->downscale > 2 || output->x > 0xFF || output->y > 0xFF)
+        return -1;
+    t->pixels = output->pixels;
+    t->stride = output->stride;
+    t->format = output->format;
+    t->downscale = output->downscale == 2 ? 2 : 1;
+    t->x = output->x;
+    t->y = output->y;
+    t->width = output->width;
+    t->height = output->height;
+    t->palette = output->palette;
+    return 0;
+}
+
+//frozen instance of r in the savestate data for reset_gameboy, also used by the vector env
+//NULL if the state is invalid, from another rom or out of memory
+gameboy *create_reset_state(const rom *r, const uint8_t *data, size_t size) {
+    gameboy *gb = create_gameboy();
+    if (gb == NULL)
+        return NULL;
+    gb->verbose = 0;
+    machine_init(gb, r);
+    if (load_state(gb, data, size) != 0 || freeze_gameboy(gb) != 0) {
+        destroy_gameboy(gb);
+        return NULL;
+    }
+    return gb;
+}
+
+static gbemu *create(gbemu *emu) {
+    emu->gb = create_gameboy();
+    if (emu->gb == NULL) {
+        free_rom(&emu->cart);
+        delete emu;
+        return NULL;
+    }
+    emu->gb->verbose = 0;
+    emu->draw = 1;
+    emu->frames = 0;
+    machine_init(emu->gb, &emu->cart);
+    return emu;
+}
+
+int gbemu_api_version(void) {
+    return GBEMU_API_VERSION;
+}
+
+gbemu *gbemu_create(const uint8_t *rom, size_t size) {
+    gbemu *emu = new (std::nothrow) gbemu();
+    if (emu == NULL)
+        return NULL;
+    if (load_rom_buffer(&emu->cart, rom, size)) {
+        delete emu;
+        return NULL;
+    }
+    return create(emu);
+}
+
+gbemu *gbemu_create_file(const char *path) {
+    gbemu *emu = new (std::nothrow) gbemu();
+    if (emu == NULL)
+        return NULL;
+    if (load_rom_file(&emu->cart, path)) {
+        delete emu;
+        return NULL;
+    }
+    return create(emu);
+}
+
+void gbemu_destroy(gbemu *emu) {
+    if (emu == NULL)
+        return;
+    destroy_gameboy(emu->gb);
+    destroy_gameboy(emu->reset_state);
+    free_rom(&emu->cart);
+    delete emu;
+}
+
+void gbemu_reset(gbemu *emu) {
+    uint8_t verbose = emu->gb->verbose;
+    if (emu->reset_state != NULL) {
+        reset_gameboy(emu->reset_state, emu->gb);
+        //gbemu_wram and gbemu_hram point into memory, their pages are copied back so they stay the live ones
+        for (int n : {WRAM >> PAGE_SHIFT, (WRAM >> PAGE_SHIFT) + 1, HRAM >> PAGE_SHIFT})
+            if (emu->gb->shared_pages >> n & 1)
+                unshare_page(emu->gb, n);
+    } else
+        machine_init(emu->gb, &emu->cart);
+    emu->gb->verbose = verbose;
+    emu->frames = 0;
+}
+
+int gbemu_set_reset_state(gbemu *emu, const uint8_t *data, size_t size) {
+    gameboy *state = NULL;
+    if (data != NULL && (state = create_reset_state(&emu->cart, data, size)) == NULL)
+        return -1;
+    destroy_gameboy(emu->reset_state);
+    emu->reset_state = state;
+    return 0;
+}
+
+uint64_t gbemu_step_frames(gbemu *emu, uint32_t n) {
+    gameboy *gb = emu->gb;
+    uint64_t start = gb->total_cycles;
+    for (uint32_t i = 0; i < n; i++)
+        run_frame(gb, emu->draw);
+    emu->frames += n;
+    return gb->total_cycles - start;
+}
+
+//same loop as run_frame but the budget can end it in the middle of a frame
+uint64_t gbemu_step_cycles(gbemu *emu, uint64_t n) {
+    gameboy *gb = emu->gb;
+    uint64_t start = gb->total_cycles;
+    while (gb->total_cycles - start < n) {
+        if (step_instruction(gb)) {
+            end_frame(gb, emu->draw);
+            emu->frames++;
+        }
+        lcd_update(gb);
+    }
+    return gb->total_cycles - start;
+}
+
+void gbemu_set_joypad(gbemu *emu, uint8_t buttons) {
+    set_joypad(emu->gb, buttons);
+}
+
+void gbemu_set_render(gbemu *emu, int render) {
+    emu->draw = render != 0;
+}
+
+int gbemu_set_output(gbemu *emu, const gbemu_output *output) {
+    if (output == NULL) {
+        emu->gb->output = NULL;
+        return 0;
+    }
+    if (output->pixels == NULL || output_to_target(output, &emu->output))
+        return -1;
+    emu->gb->output = &emu->output;
+    return 0;
+}
+
+size_t gbemu_output_size(const gbemu_output *output, size_t *row_bytes) {
+    render_target t;
+    if (output_to_target(output, &t))
+        return 0;
+    return render_target_size(&t, row_bytes);
+}
+
+size_t gbemu_state_size(void) {
+    return state_size();
+}
+
+void gbemu_save_state(gbemu *emu, uint8_t *out) {
+    save_state(emu->gb, out);
+}
+
+int gbemu_load_state(gbemu *emu, const uint8_t *data, size_t size) {
+    return load_state(emu->gb, data, size);
+}
+
+uint64_t gbemu_state_hash(gbemu *emu) {
+    return state_hash(emu->gb);
+}
+
+struct gbemu_store {
+    page_store *store;
+};
+
+gbemu_store *gbemu_store_create(uint32_t max_pages, const char *backing_path) {
+    gbemu_store *s = new (std::nothrow) gbemu_store();
+    if (s == NULL)
+        return NULL;
+    if ((s->store = create_page_store(max_pages, backing_path)) == NULL) {
+        delete s;
+        return NULL;
+    }
+    return s;
+}
+
+void gbemu_store_destroy(gbemu_store *store) {
+    if (store == NULL)
+        return;
+    destroy_page_store(store->store);
+    delete store;
+}
+
+int gbemu_store_put(gbemu_store *store, gbemu *emu) {
+    return store_save(store->store, emu->gb);
+}
+
+int gbemu_store_load(gbemu_store *store, uint32_t id, gbemu *emu) {
+    return store_load(store->store, id, emu->gb);
+}
+
+void gbemu_store_release(gbemu_store *store, uint32_t id) {
+    store_release(store->store, id);
+}
+
+size_t gbemu_store_bytes(const gbemu_store *store) {
+    return store_bytes(store->store);
+}
+
+const uint8_t *gbemu_framebuffer(const gbemu *emu) {
+    return &emu->gb->framebuffer[0][0];
+}
+
+//the caller may write through the views behind write_memory, the next state hash starts over
+uint8_t *gbemu_wram(gbemu *emu) {
+    forget_state_hash(emu->gb);
+    return emu->gb->memory + WRAM;
+}
+
+uint8_t *gbemu_hram(gbemu *emu) {
+    forget_state_hash(emu->gb);
+    return emu->gb->memory + HRAM;
+}
+
+uint64_t gbemu_frames(const gbemu *emu) {
+    return emu->frames;
+}
+
+uint64_t gbemu_cycles(const gbemu *emu) {
+    return emu->gb->total_cycles;
+}
+
+uint64_t gbemu_instructions(const gbemu *emu) {
+    return emu->gb->total_instructions;
+}
@@ -0,0 +1,185 @@
+#ifndef GBEMU_H
+#define GBEMU_H
+
+//stable c abi of the emulator, built as the gbemu shared library
+//every call takes the handle returned by gbemu_create, handles share nothing and can be driven from different threads
+//pointers returned by gbemu_framebuffer, gbemu_wram and gbemu_hram point into the instance itself:
+//they stay valid and keep their address until gbemu_destroy, stepping updates them in place
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(_WIN32)
+#define GBEMU_API __declspec(dllexport)
+#else
+#define GBEMU_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//bumped when a signature or a layout below changes
+#define GBEMU_API_VERSION 6
+
+//framebuffer: one palette index (0-3) per pixel, rows of GBEMU_FRAME_WIDTH bytes
+#define GBEMU_FRAME_WIDTH 256
+#define GBEMU_FRAME_HEIGHT 256
+#define GBEMU_WRAM_SIZE 0x2000
+#define GBEMU_HRAM_SIZE 0x7F
+
+//joypad buttons for gbemu_set_joypad, 1 = pressed
+#define GBEMU_RIGHT  0x01
+#define GBEMU_LEFT   0x02
+#define GBEMU_UP     0x04
+#define GBEMU_DOWN   0x08
+#define GBEMU_A      0x10
+#define GBEMU_B      0x20
+#define GBEMU_SELECT 0x40
+#define GBEMU_START  0x80
+
+//frame output formats
+#define GBEMU_FORMAT_INDEX8  0 //one palette index per byte
+#define GBEMU_FORMAT_GRAY8   1 //one gray level per byte
+#define GBEMU_FORMAT_PACKED2 2 //four palette indexes per byte, the first pixel in the two low bits
+#define GBEMU_FORMAT_RGBA32  3 //r g b a bytes
+
+//caller buffer the frame is drawn into, scanline by scanline with no intermediate framebuffer
+typedef struct gbemu_output {
+    uint8_t *pixels;
+    //bytes from one row to the next, 0 for rows back to back
+    ptrdiff_t stride;
+    uint32_t format;
+    //1 or 2 (0 = 1), 2 halves both sides: nearest pixel for the index formats, 2x2 average for gray and rgba
+    uint32_t downscale;
+    //crop rectangle of the 256x256 frame, width and height 0 go to the edge
+    uint16_t x, y, width, height;
+    //rgba color of every palette index, r in the first byte, NULL for the default green palette
+    const uint32_t *palette;
+} gbemu_output;
+
+typedef struct gbemu gbemu;
+
+GBEMU_API int gbemu_api_version(void);
+
+//powered on instance, the rom is copied so the caller can free it, NULL on error
+GBEMU_API gbemu *gbemu_create(const uint8_t *rom, size_t size);
+GBEMU_API gbemu *gbemu_create_file(const char *path);
+GBEMU_API void gbemu_destroy(gbemu *emu);
+//power cycle with the same rom, or go back to the reset state when there is one
+GBEMU_API void gbemu_reset(gbemu *emu);
+//reset to the savestate data from now on instead of power cycling, NULL goes back to power cycling
+//the state is loaded once and the pages of the instance point into it until they are written, so a reset
+//only remaps the pages written since the last one and costs microseconds, the wram and hram pages behind
+//gbemu_wram and gbemu_hram are always copied back so the views stay live
+//returns -1 if the state is invalid or from another rom, the reset state is then unchanged
+GBEMU_API int gbemu_set_reset_state(gbemu *emu, const uint8_t *data, size_t size);
+
+//run n whole frames, returns the cycles run
+GBEMU_API uint64_t gbemu_step_frames(gbemu *emu, uint32_t n);
+//run at least n cycles, stops on the first instruction boundary after them, returns the cycles run
+GBEMU_API uint64_t gbemu_step_cycles(gbemu *emu, uint64_t n);
+//buttons held from now on, GBEMU_ mask
+GBEMU_API void gbemu_set_joypad(gbemu *emu, uint8_t buttons);
+//draw the framebuffer at the end of every frame, on by default
+GBEMU_API void gbemu_set_render(gbemu *emu, int render);
+
+//draw frames into output->pixels instead of the framebuffer, NULL goes back to the framebuffer
+//the buffer has to stay valid until the next call, returns -1 if output is invalid
+GBEMU_API int gbemu_set_output(gbemu *emu, const gbemu_output *output);
+//bytes of a tightly packed output frame, row_bytes gets the bytes of one row if not NULL
+GBEMU_API size_t gbemu_output_size(const gbemu_output *output, size_t *row_bytes);
+
+//savestates, gbemu_state_size bytes, load returns -1 if the state is invalid or from another rom
+GBEMU_API size_t gbemu_state_size(void);
+GBEMU_API void gbemu_save_state(gbemu *emu, uint8_t *out);
+GBEMU_API int gbemu_load_state(gbemu *emu, const uint8_t *data, size_t size);
+//64 bit hash of everything a savestate holds, equal states give equal hashes, only the memory written since
+//the last call is hashed again
+GBEMU_API uint64_t gbemu_state_hash(gbemu *emu);
+
+//snapshot store: savestates cut in 4 KiB pages, every distinct page is kept once however many snapshots use it
+//max_pages distinct pages fit, backing_path NULL keeps them in memory, otherwise in a sparse file mapped
+//by the store that the kernel can write cold pages back to, one thread at a time
+typedef struct gbemu_store gbemu_store;
+
+GBEMU_API gbemu_store *gbemu_store_create(uint32_t max_pages, const char *backing_path);
+GBEMU_API void gbemu_store_destroy(gbemu_store *store);
+//snapshot of emu, returns its id or -1 if the store is full
+GBEMU_API int gbemu_store_put(gbemu_store *store, gbemu *emu);
+//-1 if the id is not a live snapshot or it is from another rom
+GBEMU_API int gbemu_store_load(gbemu_store *store, uint32_t id, gbemu *emu);
+GBEMU_API void gbemu_store_release(gbemu_store *store, uint32_t id);
+//memory taken by the distinct pages and the tables
+GBEMU_API size_t gbemu_store_bytes(const gbemu_store *store);
+
+//zero copy views of the instance
+//writes through gbemu_wram and gbemu_hram skip the dirty tracking of gbemu_state_hash: fetching either view
+//makes the next hash a full one, so a caller that writes through a kept pointer fetches the view again after
+//the writes and before hashing
+GBEMU_API const uint8_t *gbemu_framebuffer(const gbemu *emu);
+GBEMU_API uint8_t *gbemu_wram(gbemu *emu);
+GBEMU_API uint8_t *gbemu_hram(gbemu *emu);
+
+GBEMU_API uint64_t gbemu_frames(const gbemu *emu);
+GBEMU_API uint64_t gbemu_cycles(const gbemu *emu);
+GBEMU_API uint64_t gbemu_instructions(const gbemu *emu);
+
+//vector env: count instances of one rom stepped together by a worker pool
+//inputs, observations and done flags are contiguous arrays with one entry per instance, so a training step
+//is one call and one buffer per side no matter how many instances there are
+//the observation of an instance is the frame (if observe_frame) followed by the ram ranges in order
+
+#define GBEMU_MAX_RANGES 16
+
+typedef struct gbemu_range {
+    uint16_t address;
+    uint16_t length;
+} gbemu_range;
+
+typedef struct gbemu_vec_config {
+    uint32_t count;
+    //workers including the calling thread, 0 = one per core
+    uint32_t threads;
+    //frames run per step with the same input, 0 = 1
+    uint32_t frame_skip;
+    //draw the frame into the observation, the frame is only drawn when set
+    int observe_frame;
+    //format, downscale and crop of the observed frame, pixels and stride are ignored
+    gbemu_output frame;
+    uint32_t range_count;
+    gbemu_range ranges[GBEMU_MAX_RANGES];
+    //an episode ends after max_frames frames (0 = never)
+    uint32_t max_frames;
+    //or when (memory[done_address] & done_mask) == done_value, if done_mask is not 0
+    uint16_t done_address;
+    uint8_t done_mask;
+    uint8_t done_value;
+} gbemu_vec_config;
+
+typedef struct gbemu_vec gbemu_vec;
+
+//NULL on error, the rom is copied once and shared by every instance
+GBEMU_API gbemu_vec *gbemu_vec_create(const uint8_t *rom, size_t size, const gbemu_vec_config *config);
+GBEMU_API gbemu_vec *gbemu_vec_create_file(const char *path, const gbemu_vec_config *config);
+GBEMU_API void gbemu_vec_destroy(gbemu_vec *vec);
+//bytes of one observation
+GBEMU_API size_t gbemu_vec_observation_size(const gbemu_vec *vec);
+//power cycle every instance, or reset it to a reset state, observations (count x observation size) can be NULL
+GBEMU_API void gbemu_vec_reset(gbemu_vec *vec, uint8_t *observations);
+//one step of every instance with inputs[i] held, writes count observations and count done flags
+//an instance that reported done is reset at the start of its next step
+GBEMU_API void gbemu_vec_step(gbemu_vec *vec, const uint8_t *inputs, uint8_t *observations, uint8_t *dones);
+//reset pool: episodes start from the savestates added here instead of power on, shared by every instance
+//episode e of instance i starts from state (i + e) % count, so runs are repeatable and every state is used
+//a reset only remaps the pages written during the episode, see gbemu_set_reset_state
+//returns the number of states in the pool, -1 if the state is invalid or from another rom
+GBEMU_API int gbemu_vec_add_reset_state(gbemu_vec *vec, const uint8_t *data, size_t size);
+//back to power cycling
+GBEMU_API void gbemu_vec_clear_reset_states(gbemu_vec *vec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //GBEMU_H
@@ -0,0 +1,86 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+
+//fast non cryptographic hash of byte blocks, sse2 only
+//four 128 bit lanes take 64 bytes per round with a 32x32 multiply like xxh3, the lanes are scrambled every
+//kilobyte and folded into 64 bits at the end, equal bytes give equal hashes on every x86-64 machine
+
+#define HASH_STRIPE 64
+#define HASH_STRIPES_PER_SCRAMBLE 16
+
+static const uint64_t hash_prime1 = 0x9E3779B185EBCA87ull;
+static const uint64_t hash_prime2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t hash_prime3 = 0x165667B19E3779F9ull;
+static const uint32_t hash_prime32 = 0x9E3779B1u;
+
+alignas(16) static const uint64_t hash_key[10] = {
+        0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull,
+        0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull, 0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull,
+        0xcb00c391bb52283cull, 0xa32e531b8b65d088ull};
+
+static inline uint64_t hash_avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= hash_prime2;
+    h ^= h >> 29;
+    h *= hash_prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline void hash_round(__m128i acc[4], const uint8_t *p) {
+    for (int j = 0; j < 4; j++) {
+        __m128i d = _mm_loadu_si128((const __m128i *) (p + 16 * j));
+        __m128i k = _mm_load_si128((const __m128i *) (hash_key + 2 * j));
+        __m128i dk = _mm_xor_si128(d, k);
+        __m128i product = _mm_mul_epu32(dk, _mm_srli_epi64(dk, 32));
+        acc[j] = _mm_add_epi64(acc[j], _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc[j] = _mm_add_epi64(acc[j], product);
+    }
+}
+
+//keeps the high bits of the lanes flowing into the low ones, a 64x32 multiply done with two 32x32 ones
+static inline void hash_scramble(__m128i acc[4]) {
+    const __m128i prime = _mm_set1_epi32((int) hash_prime32);
+    for (int j = 0; j < 4; j++) {
+        __m128i a = _mm_xor_si128(acc[j], _mm_srli_epi64(acc[j], 47));
+        a = _mm_xor_si128(a, _mm_load_si128((const __m128i *) (hash_key + 2 + 2 * j)));
+        __m128i lo = _mm_mul_epu32(a, prime);
+        __m128i hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+        acc[j] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+    }
+}
+
+static inline uint64_t hash_bytes(const void *data, size_t size, uint64_t seed) {
+    const uint8_t *p = (const uint8_t *) data;
+    __m128i acc[4];
+    for (int j = 0; j < 4; j++)
+        acc[j] = _mm_set_epi64x((long long) (seed + hash_key[2 * j + 1]), (long long) (seed ^ hash_key[2 * j]));
+    size_t stripes = size / HASH_STRIPE;
+    for (size_t i = 0; i < stripes; i++) {
+        hash_round(acc, p + i * HASH_STRIPE);
+        if (i % HASH_STRIPES_PER_SCRAMBLE == HASH_STRIPES_PER_SCRAMBLE - 1)
+            hash_scramble(acc);
+    }
+    size_t tail = size % HASH_STRIPE;
+    if (tail > 0) {
+        alignas(16) uint8_t last[HASH_STRIPE] = {};
+        memcpy(last, p + stripes * HASH_STRIPE, tail);
+        hash_round(acc, last);
+    }
+    alignas(16) uint64_t lanes[8];
+    for (int j = 0; j < 4; j++)
+        _mm_store_si128((__m128i *) (lanes + 2 * j), acc[j]);
+    uint64_t h = size * hash_prime1 ^ seed;
+    for (int i = 0; i < 8; i++) {
+        uint64_t lane = lanes[i] * hash_prime2;
+        h ^= (lane ^ lane >> 31) * hash_prime1;
+        h = (h << 27 | h >> 37) * hash_prime1 + hash_prime3;
+    }
+    return hash_avalanche(h);
+}
+
+#endif
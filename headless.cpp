@@ -0,0 +1,393 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include "gb.h"
+#include "shmring.h"
+#include "savestate.h"
+#include "rewind.h"
+#include "statehash.h"
+#include "movie.h"
+#include "checkpoint.h"
+#include "runahead.h"
+
+//headless runner, no sdl
+//usage: gbheadless rom.gb [--frames n | --cycles n] [--input file [--seek frame] [--validate]]
+//                         [--record movie [--keyframes n]] [--checkpoint file [--checkpoint-every n] [--resume]]
+//                         [--run-ahead n [--run-ahead-thread]]
+//                         [--trace file] [--video file] [--screenshot file.pgm] [--verbose]
+//                         [--shm name [--shm-slots n] [--shm-range address:length]...]
+//                         [--load-state file] [--save-state file] [--rewind kb [--rewind-back n]]
+//--input plays a movie (movie.h) or a raw file of one button byte per frame, --record writes the buttons of
+//every frame run to a movie with a keyframe every n frames when --keyframes is given, movies start from power on
+//so neither goes with --load-state
+//--seek starts at a frame of the movie, from its keyframe before that frame, --frames is then still counted from
+//power on, --validate compares the state with every keyframe of the movie and stops at the first difference,
+//the exit code is then 2
+//--checkpoint writes a checkpoint (checkpoint.h) every n frames, 3600 by default, from a writer thread, --resume
+//starts from it when it is there and runs on to --frames, so a job killed half way goes on with the same command
+//--run-ahead shows every frame n frames ahead (runahead.h), on a second thread with --run-ahead-thread, and reports
+//what it costs and the latency it hides, --video and --screenshot get the frames shown, the real run is the same
+//--trace writes the pc of every instruction like log.txt, --video appends every frame as 256x256 palette indexes,
+//--screenshot writes the last frame as a pgm, --shm publishes every frame with the registers and the
+//hex memory ranges to a shared memory ring (shmring.h), frames are only rendered when one of these needs them
+//--load-state starts from a savestate instead of power on, --save-state writes one when the run ends
+//--rewind keeps every frame in a rewind buffer of kb kilobytes and reports what it costs,
+//--rewind-back steps back n frames at the end of the run, before the screenshot and the state are written
+
+typedef std::chrono::steady_clock run_clock;
+
+typedef struct run_options {
+    const char *rom;
+    const char *input;
+    const char *record;
+    const char *trace;
+    const char *video;
+    const char *screenshot;
+    const char *shm;
+    const char *load_state;
+    const char *save_state;
+    uint32_t shm_slots;
+    uint32_t shm_range_count;
+    shm_range shm_ranges[SHM_MAX_RANGES];
+    uint64_t frames;
+    uint64_t cycles;
+    uint64_t rewind_kb;
+    uint64_t rewind_back;
+    uint64_t keyframes;
+    uint64_t seek;
+    int validate;
+    const char *checkpoint;
+    uint64_t checkpoint_every;
+    int resume;
+    uint32_t run_ahead;
+    int run_ahead_thread;
+} run_options;
+
+int write_screenshot(gameboy *gb, const char *path) {
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        printf("cannot open %s\n", path);
+        return -1;
+    }
+    fprintf(fp, "P5\n%d %d\n255\n", screen_width, screen_height);
+    uint8_t line[screen_width];
+    for (int y = 0; y < screen_height; y++) {
+        for (int x = 0; x < screen_width; x++)
+            line[x] = default_gray[gb->framebuffer[y][x] & 0x03];
+        fwrite(line, 1, screen_width, fp);
+    }
+    fclose(fp);
+    return 0;
+}
+
+FILE *open_sink(const char *path) {
+    if (path == NULL)
+        return NULL;
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+        printf("cannot open %s\n", path);
+    return fp;
+}
+
+int main(int argc, char **argv) {
+    auto process_start = run_clock::now();
+    run_options opt = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 8, 0, {}, 0, 0, 0, 0, 0, 0, 0, NULL, 3600, 0, 0, 0};
+    int verbose = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            opt.frames = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc)
+            opt.cycles = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+            opt.input = argv[++i];
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            opt.record = argv[++i];
+        else if (strcmp(argv[i], "--keyframes") == 0 && i + 1 < argc)
+            opt.keyframes = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--seek") == 0 && i + 1 < argc)
+            opt.seek = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--validate") == 0)
+            opt.validate = 1;
+        else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc)
+            opt.checkpoint = argv[++i];
+        else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc)
+            opt.checkpoint_every = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--resume") == 0)
+            opt.resume = 1;
+        else if (strcmp(argv[i], "--run-ahead") == 0 && i + 1 < argc)
+            opt.run_ahead = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--run-ahead-thread") == 0)
+            opt.run_ahead_thread = 1;
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            opt.trace = argv[++i];
+        else if (strcmp(argv[i], "--video") == 0 && i + 1 < argc)
+            opt.video = argv[++i];
+        else if (strcmp(argv[i], "--screenshot") == 0 && i + 1 < argc)
+            opt.screenshot = argv[++i];
+        else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc)
+            opt.shm = argv[++i];
+        else if (strcmp(argv[i], "--load-state") == 0 && i + 1 < argc)
+            opt.load_state = argv[++i];
+        else if (strcmp(argv[i], "--save-state") == 0 && i + 1 < argc)
+            opt.save_state = argv[++i];
+        else if (strcmp(argv[i], "--rewind") == 0 && i + 1 < argc)
+            opt.rewind_kb = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--rewind-back") == 0 && i + 1 < argc)
+            opt.rewind_back = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--shm-slots") == 0 && i + 1 < argc)
+            opt.shm_slots = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--shm-range") == 0 && i + 1 < argc && opt.shm_range_count < SHM_MAX_RANGES) {
+            char *end;
+            uint32_t address = strtoul(argv[++i], &end, 16);
+            uint32_t length = *end == ':' ? strtoul(end + 1, NULL, 16) : 0;
+            if (length == 0 || address + length > 0x10000) {
+                printf("bad memory range %s\n", argv[i]);
+                return 1;
+            }
+            opt.shm_ranges[opt.shm_range_count++] = {(uint16_t) address, (uint16_t) length};
+        } else if (strcmp(argv[i], "--verbose") == 0)
+            verbose = 1;
+        else if (argv[i][0] != '-' && opt.rom == NULL)
+            opt.rom = argv[i];
+        else {
+            printf("unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (opt.rom == NULL) {
+        printf("usage: gbheadless rom.gb [--frames n | --cycles n] [--input file [--seek frame] [--validate]]\n"
+               "                         [--record movie [--keyframes n]] [--checkpoint file [--checkpoint-every n] [--resume]]\n"
+               "                         [--run-ahead n [--run-ahead-thread]]\n"
+               "                         [--trace file] [--video file] [--screenshot file.pgm] [--verbose]\n"
+               "                         [--shm name [--shm-slots n] [--shm-range address:length]...]\n"
+               "                         [--load-state file] [--save-state file] [--rewind kb [--rewind-back n]]\n");
+        return 1;
+    }
+    if (opt.frames == 0 && opt.cycles == 0)
+        opt.frames = 60;
+
+    if (opt.load_state != NULL && (opt.input != NULL || opt.record != NULL)) {
+        printf("movies start from power on, --load-state cannot go with --input or --record\n");
+        return 1;
+    }
+    if (opt.seek > 0 && (opt.input == NULL || opt.record != NULL)) {
+        printf("--seek needs --input and cannot go with --record\n");
+        return 1;
+    }
+    if (opt.resume && (opt.checkpoint == NULL || opt.record != NULL || opt.seek > 0)) {
+        printf("--resume needs --checkpoint and cannot go with --record or --seek\n");
+        return 1;
+    }
+    if (opt.checkpoint_every == 0)
+        opt.checkpoint_every = 1;
+    movie input = {};
+    if (opt.input != NULL && load_movie(&input, opt.input))
+        return 1;
+    FILE *trace = open_sink(opt.trace);
+    FILE *video = open_sink(opt.video);
+    if ((opt.trace != NULL && trace == NULL) || (opt.video != NULL && video == NULL))
+        return 1;
+
+    rom cart;
+    if (load_rom_file(&cart, opt.rom))
+        return 1;
+    gameboy *gb = create_gameboy();
+    if (gb == NULL)
+        return 1;
+    gb->verbose = verbose;
+    machine_init(gb, &cart);
+    if (check_movie(&input, &cart))
+        return 1;
+    input_source played = movie_input(&input);
+    input_source source = played;
+    movie_recorder *recorder = NULL;
+    if (opt.record != NULL) {
+        if ((recorder = create_movie_recorder(opt.record, &cart, gb, opt.keyframes)) == NULL)
+            return 1;
+        source = recording_input(recorder, &played);
+    }
+    if (opt.load_state != NULL && load_state_file(gb, opt.load_state))
+        return 1;
+    //the ring gets full frames of palette indexes like the framebuffer
+    shm_ring *ring = NULL;
+    render_target ring_format = {NULL, 0, PIXEL_INDEX8, 1, 0, 0, 0, 0, NULL};
+    if (opt.shm != NULL &&
+        (ring = create_shm_ring(opt.shm, opt.shm_slots, &ring_format, opt.shm_ranges, opt.shm_range_count)) == NULL)
+        return 1;
+    //an hour of frames at most, the budget decides how many are really kept
+    rewind_buffer *history = NULL;
+    if (opt.rewind_kb > 0 && (history = create_rewind(opt.rewind_kb << 10, 60 * 60 * 60, 60)) == NULL) {
+        printf("cannot allocate the rewind buffer\n");
+        return 1;
+    }
+    //the frames shown are drawn into the framebuffer by the fork running ahead
+    runahead *ahead = NULL;
+    render_target shown = {&gb->framebuffer[0][0], 0, PIXEL_INDEX8, 1, 0, 0, 0, 0, NULL};
+    if (opt.run_ahead > 0 && (ahead = create_runahead(opt.run_ahead, opt.run_ahead_thread)) == NULL) {
+        printf("cannot start the run-ahead\n");
+        return 1;
+    }
+    run_clock::duration capture_time{};
+    auto start = run_clock::now();
+    double startup_ms = std::chrono::duration<double, std::milli>(start - process_start).count();
+
+    uint64_t frame = 0;
+    int draw = video != NULL;
+    double seek_ms = 0;
+    //0 once resumed from the checkpoint
+    int resumed = 1;
+    if (opt.resume && (resumed = resume_checkpoint(gb, opt.checkpoint, &frame)) < 0)
+        return 1;
+    if (opt.seek > 0) {
+        if (movie_seek(&input, gb, &cart, opt.seek))
+            return 1;
+        frame = opt.seek;
+        auto seeked = run_clock::now();
+        seek_ms = std::chrono::duration<double, std::milli>(seeked - start).count();
+        start = seeked;
+    } else
+        set_joypad(gb, source.poll(&source, frame));
+    if (ahead != NULL)
+        runahead_start(ahead, gb, &shown);
+    uint64_t first_frame = frame;
+    checkpointer *checkpoints = NULL;
+    if (opt.checkpoint != NULL && (checkpoints = create_checkpointer(opt.checkpoint)) == NULL) {
+        printf("cannot start the checkpoint writer\n");
+        return 1;
+    }
+    run_clock::duration checkpoint_time{};
+    uint64_t validated = 0;
+    int valid = 1;
+    char invalid_at[32] = "-";
+    while ((opt.frames == 0 || frame < opt.frames) && (opt.cycles == 0 || gb->total_cycles < opt.cycles)) {
+        if (trace != NULL)
+            trace_pc(gb, trace);
+        if (step_instruction(gb)) {
+            int last = opt.frames != 0 && frame + 1 == opt.frames;
+            if (ahead != NULL)
+                runahead_finish(ahead);
+            if (ring != NULL) {
+                //the frame is drawn into the ring, the framebuffer only gets a copy when a sink needs it
+                shm_ring_begin(ring, gb);
+                end_frame(gb, 1);
+                shm_ring_publish(ring, gb);
+                if (ahead == NULL && (draw || (last && opt.screenshot != NULL)))
+                    memcpy(gb->framebuffer, ring->target.pixels, sizeof(gb->framebuffer));
+            } else
+                end_frame(gb, ahead == NULL && (draw || (last && opt.screenshot != NULL)));
+            if (video != NULL)
+                fwrite(gb->framebuffer, 1, sizeof(gb->framebuffer), video);
+            frame++;
+            if (opt.validate) {
+                int checked = movie_check(&input, gb, frame, invalid_at, sizeof(invalid_at));
+                if (checked < 0) {
+                    valid = 0;
+                    break;
+                }
+                validated += checked;
+            }
+            if (checkpoints != NULL && frame % opt.checkpoint_every == 0) {
+                auto checkpoint_start = run_clock::now();
+                take_checkpoint(checkpoints, gb, frame);
+                checkpoint_time += run_clock::now() - checkpoint_start;
+            }
+            //no input for a frame that will not run, a recorded movie has as many frames as the run
+            if (!last) {
+                set_joypad(gb, source.poll(&source, frame));
+                if (ahead != NULL)
+                    runahead_start(ahead, gb, &shown);
+            }
+            if (history != NULL) {
+                auto capture_start = run_clock::now();
+                rewind_capture(history, gb);
+                capture_time += run_clock::now() - capture_start;
+            }
+        }
+        lcd_update(gb);
+    }
+    if (ahead != NULL)
+        runahead_finish(ahead);
+    double seconds = std::chrono::duration<double>(run_clock::now() - start).count();
+    if (checkpoints != NULL)
+        stop_checkpointer(checkpoints);
+    uint64_t rewound = 0;
+    while (history != NULL && rewound < opt.rewind_back && rewind_step(history, gb) == 0)
+        rewound++;
+    frame -= rewound;
+
+    //a cycle budget can stop in the middle of a frame
+    if (opt.screenshot != NULL) {
+        if (opt.frames == 0 || rewound > 0 || !valid)
+            render(gb);
+        write_screenshot(gb, opt.screenshot);
+    }
+    if (trace != NULL)
+        fclose(trace);
+    if (video != NULL)
+        fclose(video);
+    free_movie(&input);
+    if (close_movie_recorder(recorder))
+        return 1;
+
+    char regs_text[0x100];
+    regop_to_string(gb, regs_text, sizeof(regs_text));
+    printf("rom: %s\n", opt.rom);
+    printf("frames: %llu\n", (unsigned long long) frame);
+    printf("cycles: %llu\n", (unsigned long long) gb->total_cycles);
+    printf("instructions: %llu\n", (unsigned long long) gb->total_instructions);
+    printf("startup_ms: %.3f\n", startup_ms);
+    printf("seconds: %.6f\n", seconds);
+    printf("frames_per_second: %.1f\n", seconds > 0 ? (frame - first_frame) / seconds : 0);
+    printf("registers: %s\n", regs_text);
+    printf("state_hash: %016llx\n", (unsigned long long) state_hash(gb));
+    if (history != NULL) {
+        double capture_seconds = std::chrono::duration<double>(capture_time).count();
+        uint64_t captured = frame - first_frame + rewound;
+        printf("rewind_frames: %u\n", history->count);
+        printf("rewind_bytes: %llu\n", (unsigned long long) history->used);
+        printf("rewind_bytes_per_minute: %.0f\n", history->count > 0 ? history->used * 3600.0 / history->count : 0);
+        printf("rewind_capture_us: %.3f\n", captured > 0 ? capture_seconds * 1e6 / captured : 0);
+        printf("rewind_capture_fraction: %.4f\n", seconds > 0 ? capture_seconds / seconds : 0);
+        printf("rewound: %llu\n", (unsigned long long) rewound);
+    }
+    if (opt.seek > 0)
+        printf("seek_ms: %.3f\n", seek_ms);
+    if (resumed == 0)
+        printf("resumed_from: %llu\n", (unsigned long long) first_frame);
+    if (checkpoints != NULL) {
+        uint64_t written = checkpoints->written;
+        printf("checkpoints_taken: %llu\n", (unsigned long long) checkpoints->taken);
+        printf("checkpoints_written: %llu\n", (unsigned long long) written);
+        printf("checkpoints_skipped: %llu\n", (unsigned long long) checkpoints->skipped);
+        printf("checkpoints_failed: %llu\n", (unsigned long long) checkpoints->failed);
+        printf("checkpoint_take_us: %.3f\n", checkpoints->taken > 0 ?
+               std::chrono::duration<double, std::micro>(checkpoint_time).count() / checkpoints->taken : 0);
+        printf("checkpoint_write_ms: %.3f\n", written > 0 ? checkpoints->write_seconds * 1e3 / written : 0);
+    }
+    if (ahead != NULL) {
+        uint64_t started = ahead->started;
+        printf("run_ahead_frames: %u\n", ahead->frames);
+        printf("run_ahead_threaded: %d\n", ahead->threaded);
+        printf("run_ahead_forks: %llu\n", (unsigned long long) ahead->forks);
+        printf("run_ahead_frames_per_frame: %.3f\n", started > 0 ? (double) ahead->speculative_frames / started : 0);
+        printf("run_ahead_wait_us: %.3f\n", started > 0 ? ahead->wait_seconds * 1e6 / started : 0);
+        printf("latency_saved_ms: %.3f\n", runahead_saved_ms(ahead));
+    }
+    if (opt.validate) {
+        printf("validated_keyframes: %llu\n", (unsigned long long) validated);
+        printf("validation: %s\n", valid ? "ok" : "failed");
+        if (!valid)
+            printf("validation_failed_at: frame %llu %s\n", (unsigned long long) frame, invalid_at);
+    }
+    if (opt.save_state != NULL && save_state_file(gb, opt.save_state))
+        return 1;
+    destroy_shm_ring(ring);
+    destroy_rewind(history);
+    destroy_checkpointer(checkpoints);
+    destroy_runahead(ahead);
+    destroy_gameboy(gb);
+    free_rom(&cart);
+    return valid ? 0 : 2;
+}
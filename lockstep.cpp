@@ -0,0 +1,383 @@
+#include <new>
+#include "lockstep.h"
+
+//pick the widest vector unit at load time where the loader supports it
+#if defined(__x86_64__) && defined(__linux__)
+#define LOCKSTEP_CLONES __attribute__((target_clones("arch=x86-64-v4", "avx2", "default")))
+#else
+#define LOCKSTEP_CLONES
+#endif
+
+#define FLAG_Z 0x80
+#define FLAG_N 0x40
+#define FLAG_H 0x20
+#define FLAG_C 0x10
+
+lockstep *create_lockstep(uint32_t count, const rom *r) {
+    lockstep *ls = new (std::nothrow) lockstep();
+    if (ls == NULL)
+        return NULL;
+    ls->count = count;
+    ls->blocks = (count + LOCKSTEP_LANES - 1) / LOCKSTEP_LANES;
+    ls->block = new (std::nothrow) lockstep_block[ls->blocks]();
+    ls->lane = new (std::nothrow) gameboy *[count]();
+    if (ls->block == NULL || ls->lane == NULL) {
+        destroy_lockstep(ls);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        ls->lane[i] = create_gameboy();
+        if (ls->lane[i] == NULL) {
+            destroy_lockstep(ls);
+            return NULL;
+        }
+        //lanes are quiet, the debug messages of hundreds of instances would drown the output
+        ls->lane[i]->verbose = 0;
+        machine_init(ls->lane[i], r);
+    }
+    return ls;
+}
+
+void destroy_lockstep(lockstep *ls) {
+    if (ls == NULL)
+        return;
+    if (ls->lane != NULL) {
+        for (uint32_t i = 0; i < ls->count; i++)
+            destroy_gameboy(ls->lane[i]);
+    }
+    delete[] ls->lane;
+    delete[] ls->block;
+    delete ls;
+}
+
+//instructions the vector path runs, all of them only touch registers
+int vector_opcode(uint8_t opcode) {
+    switch (opcode) {
+        case 0x00://NOP
+        case 0x18://JR r8
+        case 0x20://JR NZ,r8
+        case 0x28://JR Z,r8
+            return 1;
+        case 0x40 ... 0x7F://LD r,r
+            return (opcode & 0x07) != 6 && (opcode & 0x38) != 0x30;
+        case 0x80 ... 0x87://ADD
+        case 0x90 ... 0x97://SUB
+        case 0xA0 ... 0xBF://AND XOR OR CP
+            return (opcode & 0x07) != 6;
+    }
+    //INC r, DEC r, LD r,d8
+    if (opcode < 0x40 && (opcode & 0x38) != 0x30)
+        return (opcode & 0x07) == 4 || (opcode & 0x07) == 5 || (opcode & 0x07) == 6;
+    return 0;
+}
+
+//run opcode on the lanes of active, operand is the byte after the opcode of each lane
+//flags and cycles follow cpu_step exactly, quirks included
+//every case is a branch free loop over the lanes so the compiler turns it into vector code
+LOCKSTEP_CLONES
+void vector_step(lockstep_block *b, const uint8_t *active, uint8_t opcode, const uint8_t *operand) {
+    uint8_t *F = b->r[6], *A = b->r[7];
+    int d = (opcode >> 3) & 0x07, s = opcode & 0x07;
+    uint32_t cycles = 1;
+    uint16_t length = 1;
+    switch (opcode) {
+        case 0x00://NOP
+            break;
+        case 0x18://JR r8
+        case 0x20://JR NZ,r8
+        case 0x28://JR Z,r8
+            //pc and cycles depend on the lane
+            for (int i = 0; i < LOCKSTEP_LANES; i++) {
+                int on = active[i] != 0;
+                int taken = opcode == 0x18 || ((F[i] & FLAG_Z) != 0) == (opcode == 0x28);
+                uint16_t offset = (int8_t) operand[i];
+                uint32_t last = b->last_cycles[i];
+                uint32_t lane_cycles = taken ? 3 : 2;
+                b->PC[i] += on ? (uint16_t) (taken ? 2 + offset : 2) : 0;
+                b->frame_counter[i] -= on ? lane_cycles : 0;
+                b->last_cycles[i] = on ? lane_cycles : last;
+                b->cycles[i] += on ? lane_cycles : 0;
+                b->instructions[i] += on;
+            }
+            return;
+        case 0x40 ... 0x7F: {//LD r,r
+            uint8_t *dst = b->r[d], *src = b->r[s];
+            for (int i = 0; i < LOCKSTEP_LANES; i++) {
+                uint8_t v = src[i], old = dst[i];
+                dst[i] = active[i] ? v : old;
+            }
+            break;
+        }
+        case 0x80 ... 0x87://ADD A,r
+            for (int i = 0; i < LOCKSTEP_LANES; i++) {
+                uint8_t a = A[i], t = b->r[s][i], f = F[i];
+                uint8_t res = a + t;
+                uint8_t flags = (res == 0 ? FLAG_Z : 0) | ((res & 0x0F) < (t & 0x0F) ? FLAG_H : 0) |
+                                (res < t ? FLAG_C : 0);
+                A[i] = active[i] ? res : a;
+                F[i] = active[i] ? (uint8_t) ((f & 0x0F) | flags) : f;
+            }
+            break;
+        case 0x90 ... 0x97://SUB r
+            for (int i = 0; i < LOCKSTEP_LANES; i++) {
+                uint8_t a = A[i], t = b->r[s][i], f = F[i];
+                uint8_t res = a - t;
+                uint8_t flags = (res == 0 ? FLAG_Z : 0) | FLAG_N | ((res & 0x0F) > (t & 0x0F) ? FLAG_H : 0) |
+                                (res > t ? FLAG_C : 0);
+                A[i] = active[i] ? res : a;
+                F[i] = active[i] ? (uint8_t) ((f & 0x0F) | flags) : f;
+            }
+            break;
+        case 0xA0 ... 0xA7://AND r
+            for (int i = 0; i < LOCKSTEP_LANES; i++) {
+                uint8_t a = A[i], t = b->r[s][i], f = F[i];
+                uint8_t res = a & t;
+                A[i] = active[i] ? res : a;
+                F[i] = active[i] ? (uint8_t) ((f & 0x0F) | (res == 0 ? FLAG_Z : 0) | FLAG_H) : f;
+            }
+            break;
+        case 0xA8 ... 0xAF://XOR r
+            for (int i = 0; i < LOCKSTEP_LANES; i++) {
+                uint8_t a = A[i], t = b->r[s][i], f = F[i];
+                uint8_t res = a ^ t;
+                A[i] = active[i] ? res : a;
+                F[i] = active[i] ? (uint8_t) ((f & 0x0F) | (res == 0 ? FLAG_Z : 0)) : f;
+            }
+            break;
+        case 0xB0 ... 0xB7://OR r
+            for (int i = 0; i < LOCKSTEP_LANES; i++) {
+                uint8_t a = A[i], t = b->r[s][i], f = F[i];
+                uint8_t res = a | t;
+                A[i] = active[i] ? res : a;
+                F[i] = active[i] ? (uint8_t) ((f & 0x0F) | (res == 0 ? FLAG_Z : 0)) : f;
+            }
+            break;
+        case 0xB8 ... 0xBF://CP r
+            for (int i = 0; i < LOCKSTEP_LANES; i++) {
+                uint8_t a = A[i], t = b->r[s][i], f = F[i];
+                uint8_t flags = (a == t ? FLAG_Z : 0) | FLAG_N | ((a & 0x0F) > (t & 0x0F) ? FLAG_H : 0) |
+                                (a > t ? FLAG_C : 0);
+                F[i] = active[i] ? (uint8_t) ((f & 0x0F) | flags) : f;
+            }
+            break;
+        default: {
+            uint8_t *dst = b->r[d];
+            const uint8_t *B = b->r[0];
+            if (s == 6) {//LD r,d8
+                for (int i = 0; i < LOCKSTEP_LANES; i++) {
+                    uint8_t v = operand[i], old = dst[i];
+                    dst[i] = active[i] ? v : old;
+                }
+                cycles = 2;
+                length = 2;
+            } else if (s == 4) {//INC r
+                for (int i = 0; i < LOCKSTEP_LANES; i++) {
+                    uint8_t v = dst[i], f = F[i];
+                    uint8_t res = v + 1;
+                    uint8_t flags = (res == 0 ? FLAG_Z : 0) | ((v & 0x0F) == 0x0F ? FLAG_H : 0);
+                    F[i] = active[i] ? (uint8_t) ((f & (0x0F | FLAG_C)) | flags) : f;
+                    dst[i] = active[i] ? res : v;
+                }
+            } else if (d == 5) {//DEC L, h is bit 4 of the result
+                for (int i = 0; i < LOCKSTEP_LANES; i++) {
+                    uint8_t v = dst[i], f = F[i];
+                    uint8_t res = v - 1;
+                    uint8_t flags = (res == 0 ? FLAG_Z : 0) | ((res & 0x10) ? FLAG_H : 0);
+                    F[i] = active[i] ? (uint8_t) ((f & (0x0F | FLAG_C)) | flags) : f;
+                    dst[i] = active[i] ? res : v;
+                }
+            } else if (d == 7) {//DEC A, the only one setting n
+                for (int i = 0; i < LOCKSTEP_LANES; i++) {
+                    uint8_t v = dst[i], f = F[i];
+                    uint8_t res = v - 1;
+                    uint8_t flags = (res == 0 ? FLAG_Z : 0) | FLAG_N | ((res & 0x0F) == 0x0F ? FLAG_H : 0);
+                    F[i] = active[i] ? (uint8_t) ((f & (0x0F | FLAG_C)) | flags) : f;
+                    dst[i] = active[i] ? res : v;
+                }
+            } else {//DEC r, DEC D tests B
+                const uint8_t *Z = d == 2 ? B : dst;
+                for (int i = 0; i < LOCKSTEP_LANES; i++) {
+                    uint8_t v = dst[i], f = F[i];
+                    uint8_t res = v - 1;
+                    uint8_t z = d == 2 ? Z[i] : res;
+                    uint8_t flags = (z == 0 ? FLAG_Z : 0) | ((v & 0x0F) == 0 ? FLAG_H : 0);
+                    F[i] = active[i] ? (uint8_t) ((f & (0x0F | FLAG_C)) | flags) : f;
+                    dst[i] = active[i] ? res : v;
+                }
+            }
+            break;
+        }
+    }
+    for (int i = 0; i < LOCKSTEP_LANES; i++) {
+        int on = active[i] != 0;
+        uint32_t last = b->last_cycles[i];
+        b->PC[i] += on ? length : 0;
+        b->frame_counter[i] -= on ? cycles : 0;
+        b->last_cycles[i] = on ? cycles : last;
+        b->cycles[i] += on ? cycles : 0;
+        b->instructions[i] += on;
+    }
+}
+
+void lane_load(lockstep_block *b, int i, const gameboy *gb) {
+    b->r[0][i] = gb->reg.B;
+    b->r[1][i] = gb->reg.C;
+    b->r[2][i] = gb->reg.D;
+    b->r[3][i] = gb->reg.E;
+    b->r[4][i] = gb->reg.H;
+    b->r[5][i] = gb->reg.L;
+    b->r[6][i] = gb->reg.F;
+    b->r[7][i] = gb->reg.A;
+    b->SP[i] = gb->reg.SP;
+    b->PC[i] = gb->reg.PC;
+    b->frame_counter[i] = gb->frame_counter;
+    b->last_cycles[i] = gb->last_amount_cycles;
+    //a scalar step can switch banks
+    if (b->code_page >= 0)
+        b->code[i] = gb->page[b->code_page];
+}
+
+void lane_store(const lockstep_block *b, int i, gameboy *gb) {
+    gb->reg.B = b->r[0][i];
+    gb->reg.C = b->r[1][i];
+    gb->reg.D = b->r[2][i];
+    gb->reg.E = b->r[3][i];
+    gb->reg.H = b->r[4][i];
+    gb->reg.L = b->r[5][i];
+    gb->reg.F = b->r[6][i];
+    gb->reg.A = b->r[7][i];
+    gb->reg.SP = b->SP[i];
+    gb->reg.PC = b->PC[i];
+    gb->frame_counter = b->frame_counter[i];
+    gb->last_amount_cycles = b->last_cycles[i];
+}
+
+//one frame of every lane of a block
+//the group is the lanes on the lowest pc, so lanes that branched apart meet again where the code joins
+void run_block(lockstep *ls, uint32_t index, int draw) {
+    lockstep_block *b = &ls->block[index];
+    gameboy **lane = ls->lane + index * LOCKSTEP_LANES;
+    int n = ls->count - index * LOCKSTEP_LANES;
+    if (n > LOCKSTEP_LANES)
+        n = LOCKSTEP_LANES;
+    alignas(64) uint8_t done[LOCKSTEP_LANES], active[LOCKSTEP_LANES], operand[LOCKSTEP_LANES];
+    //lcd_update has run since the last instruction, the vector path skips it because it would not change anything
+    alignas(64) uint8_t forced[LOCKSTEP_LANES];
+    int left = n;
+    b->code_page = -1;
+    for (int i = 0; i < LOCKSTEP_LANES; i++) {
+        done[i] = i >= n;
+        forced[i] = 0;
+        b->cycles[i] = 0;
+        b->instructions[i] = 0;
+        if (i < n) {
+            lane_load(b, i, lane[i]);
+            forced[i] = read_memory(lane[i], 0xFF40) == 0x70 && read_memory(lane[i], 0xFF41) == 0x93;
+        }
+    }
+
+    while (left > 0) {
+        uint16_t pc = 0xFFFF;
+        for (int i = 0; i < LOCKSTEP_LANES; i++) {
+            uint16_t lane_pc = b->PC[i] | (uint16_t) -done[i];
+            pc = lane_pc < pc ? lane_pc : pc;
+        }
+        //a lane sitting on 0xFFFF itself
+        if (pc == 0xFFFF) {
+            for (int i = 0; i < LOCKSTEP_LANES && pc == 0xFFFF; i++)
+                pc = done[i] ? pc : b->PC[i];
+        }
+
+        int page = pc >> PAGE_SHIFT;
+        if (page != b->code_page) {
+            b->code_page = page;
+            for (int i = 0; i < LOCKSTEP_LANES; i++)
+                b->code[i] = i < n ? lane[i]->page[page] : lane[0]->page[page];
+        }
+        int group = 0, leader = -1;
+        for (int i = 0; i < LOCKSTEP_LANES; i++) {
+            active[i] = (done[i] == 0) & (forced[i] != 0) & (b->PC[i] == pc) ? 0xFF : 0;
+        }
+        for (int i = 0; i < LOCKSTEP_LANES && leader < 0; i++)
+            leader = active[i] ? i : leader;
+        uint8_t opcode = 0;
+        if (leader >= 0) {
+            //rom banks are shared by every lane, ram pages are not
+            uint16_t at = pc & (PAGE_SIZE - 1);
+            const uint8_t *code = b->code[leader];
+            int shared = 1;
+            for (int i = 0; i < LOCKSTEP_LANES; i++)
+                shared &= (active[i] == 0) | (b->code[i] == code);
+            opcode = code[at];
+            if (!shared) {
+                //every lane loads without a branch so the loads overlap
+                alignas(64) uint8_t lane_opcode[LOCKSTEP_LANES];
+                for (int i = 0; i < LOCKSTEP_LANES; i++)
+                    lane_opcode[i] = b->code[i][at];
+                for (int i = 0; i < LOCKSTEP_LANES; i++)
+                    active[i] &= lane_opcode[i] == opcode ? 0xFF : 0;
+            }
+            for (int i = 0; i < LOCKSTEP_LANES; i++)
+                group += active[i] != 0;
+            //only jr and ld r,d8 read the byte after the opcode
+            if (group >= 2 && vector_opcode(opcode) && (opcode == 0x18 || opcode == 0x20 || opcode == 0x28 ||
+                                                         (opcode < 0x40 && (opcode & 0x07) == 6))) {
+                for (int i = 0; i < LOCKSTEP_LANES; i++) {
+                    if (!active[i])
+                        continue;
+                    if (at + 1 < PAGE_SIZE)
+                        operand[i] = b->code[i][at + 1];
+                    else
+                        operand[i] = read_memory(lane[i], pc + 1);
+                }
+            }
+        }
+
+        if (group >= 2 && vector_opcode(opcode)) {
+            vector_step(b, active, opcode, operand);
+            ls->vector_instructions += group;
+            int ended = 0;
+            for (int i = 0; i < LOCKSTEP_LANES; i++)
+                ended |= (active[i] != 0) & (b->frame_counter[i] <= 0);
+            if (!ended)
+                continue;
+            for (int i = 0; i < LOCKSTEP_LANES; i++) {
+                if (active[i] && b->frame_counter[i] <= 0) {
+                    lane_store(b, i, lane[i]);
+                    end_frame(lane[i], draw);
+                    lcd_update(lane[i]);
+                    lane_load(b, i, lane[i]);
+                    done[i] = 1;
+                    left--;
+                }
+            }
+            continue;
+        }
+        for (int i = 0; i < LOCKSTEP_LANES; i++) {
+            if (done[i] || b->PC[i] != pc)
+                continue;
+            gameboy *gb = lane[i];
+            lane_store(b, i, gb);
+            if (step_instruction(gb)) {
+                end_frame(gb, draw);
+                done[i] = 1;
+                left--;
+            }
+            lcd_update(gb);
+            lane_load(b, i, gb);
+            forced[i] = 1;
+            ls->scalar_instructions++;
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        lane_store(b, i, lane[i]);
+        lane[i]->total_cycles += b->cycles[i];
+        lane[i]->total_instructions += b->instructions[i];
+    }
+}
+
+void lockstep_run_frame(lockstep *ls, int draw) {
+    for (uint32_t i = 0; i < ls->blocks; i++)
+        run_block(ls, i, draw);
+}
@@ -0,0 +1,47 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include "gb.h"
+
+//experimental lockstep engine: many instances of the same rom stepped together
+//registers and counters are kept as arrays with one entry per lane, lanes that sit on the same pc
+//and opcode run that instruction as one vector operation (avx-512, avx2 or sse picked at load time),
+//everything the vector path does not cover runs through cpu_step one lane at a time
+//every lane still gives exactly the result of run_frame on its own instance
+
+//lanes in a block, one byte register of the whole block fills one avx-512 register
+#define LOCKSTEP_LANES 64
+
+//registers of a block, r is indexed like the opcode register field: B C D E H L F A
+typedef struct alignas(64) lockstep_block {
+    uint8_t r[8][LOCKSTEP_LANES];
+    uint16_t SP[LOCKSTEP_LANES];
+    uint16_t PC[LOCKSTEP_LANES];
+    int32_t frame_counter[LOCKSTEP_LANES];
+    uint32_t last_cycles[LOCKSTEP_LANES];
+    //run by the vector path this frame, added to the instance totals at the end of the frame
+    uint32_t cycles[LOCKSTEP_LANES];
+    uint32_t instructions[LOCKSTEP_LANES];
+    //page code_page of every lane, so fetching the group opcode does not walk every instance
+    const uint8_t *code[LOCKSTEP_LANES];
+    int code_page;
+} lockstep_block;
+
+typedef struct lockstep {
+    uint32_t count;
+    uint32_t blocks;
+    lockstep_block *block;
+    //one instance per lane for memory and everything else, registers are only valid between frames
+    gameboy **lane;
+    //lane instructions run by each path
+    uint64_t vector_instructions;
+    uint64_t scalar_instructions;
+} lockstep;
+
+//count powered on instances of r, quiet (verbose 0), NULL if out of memory
+lockstep *create_lockstep(uint32_t count, const rom *r);
+void destroy_lockstep(lockstep *ls);
+//run_frame on every lane, joypads are set on the lane instances before the call
+void lockstep_run_frame(lockstep *ls, int draw);
+
+#endif
@@ -0,0 +1,332 @@
+#include "movie.h"
+#include "hash.h"
+#include "rewind.h"
+#include "savestate.h"
+#include "statehash.h"
+
+//a week of frames, a longer movie is a broken file
+#define MOVIE_MAX_FRAMES (60ull * 60 * 60 * 24 * 7)
+
+uint64_t rom_hash(const rom *r) {
+    return hash_bytes(r->buffer, r->size, 0);
+}
+
+//decode size bytes of runs into frames buttons, -1 if they do not add up
+static int decode_runs(const uint8_t *p, size_t size, uint8_t *buttons, uint64_t frames) {
+    const uint8_t *end = p + size;
+    uint64_t frame = 0;
+    while (p < end) {
+        uint8_t value = *p++;
+        uint64_t run = 0;
+        int shift = 0;
+        uint8_t byte;
+        do {
+            if (p == end || shift > 63)
+                return -1;
+            byte = *p++;
+            run |= (uint64_t) (byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        if (run >= frames - frame)
+            return -1;
+        memset(buttons + frame, value, run + 1);
+        frame += run + 1;
+    }
+    return frame == frames ? 0 : -1;
+}
+
+static int read_at(FILE *fp, uint64_t offset, void *data, size_t size) {
+    if (fseek(fp, (long) offset, SEEK_SET) != 0)
+        return -1;
+    return fread(data, 1, size, fp) == size ? 0 : -1;
+}
+
+//the index is in frame order and the keyframes are inside the file
+static int check_index(const movie *m, uint64_t length) {
+    for (uint64_t k = 0; k < m->keyframe_count; k++) {
+        const movie_keyframe *key = &m->keyframes[k];
+        if (key->frame > m->frames || (k > 0 && key->frame <= key[-1].frame) || key->offset > length ||
+            key->size > length - key->offset)
+            return -1;
+    }
+    return 0;
+}
+
+int load_movie(movie *m, const char *path) {
+    *m = {0, 0, NULL, 0, 0, NULL, NULL};
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        printf("cannot open input %s\n", path);
+        return -1;
+    }
+    movie_header h = {};
+    size_t got = fread(&h, 1, sizeof(h), fp);
+    if (got < MOVIE_V1_HEADER || h.magic != MOVIE_MAGIC) {
+        //a raw input file, the data is the buttons already
+        fclose(fp);
+        size_t length;
+        if ((m->buttons = load_input(path, &length)) == NULL)
+            return -1;
+        m->frames = length;
+        return 0;
+    }
+    if (h.version == 1) {
+        h.keyframe_interval = 0;
+        h.input_offset = MOVIE_V1_HEADER;
+        h.index_offset = 0;
+        h.keyframe_count = 0;
+    }
+    fseek(fp, 0, SEEK_END);
+    uint64_t length = ftell(fp);
+    uint8_t *code = NULL;
+    int bad = (h.version != 1 && (h.version != MOVIE_VERSION || got < sizeof(h))) || h.input_offset > length ||
+              h.input_size > length - h.input_offset || h.frames > MOVIE_MAX_FRAMES ||
+              h.keyframe_count > length / sizeof(movie_keyframe) || h.index_offset > length ||
+              h.keyframe_count * sizeof(movie_keyframe) > length - h.index_offset;
+    if (!bad) {
+        m->frames = h.frames;
+        m->keyframe_count = h.keyframe_count;
+        m->buttons = (uint8_t *) malloc(h.frames > 0 ? h.frames : 1);
+        m->keyframes = (movie_keyframe *) malloc(h.keyframe_count > 0 ? h.keyframe_count * sizeof(movie_keyframe) : 1);
+        code = (uint8_t *) malloc(h.input_size > 0 ? h.input_size : 1);
+        bad = m->buttons == NULL || m->keyframes == NULL || code == NULL ||
+              read_at(fp, h.input_offset, code, h.input_size) ||
+              decode_runs(code, h.input_size, m->buttons, h.frames) ||
+              read_at(fp, h.index_offset, m->keyframes, h.keyframe_count * sizeof(movie_keyframe)) ||
+              check_index(m, length);
+    }
+    free(code);
+    if (bad) {
+        printf("bad movie %s\n", path);
+        fclose(fp);
+        free_movie(m);
+        return -1;
+    }
+    m->rom_hash = h.rom_hash;
+    m->keyframe_interval = h.keyframe_interval;
+    //the keyframes are read from the file when they are needed
+    if (m->keyframe_count > 0)
+        m->fp = fp;
+    else
+        fclose(fp);
+    return 0;
+}
+
+void free_movie(movie *m) {
+    free(m->buttons);
+    free(m->keyframes);
+    if (m->fp != NULL)
+        fclose(m->fp);
+    *m = {0, 0, NULL, 0, 0, NULL, NULL};
+}
+
+int check_movie(const movie *m, const rom *r) {
+    if (m->rom_hash != 0 && m->rom_hash != rom_hash(r)) {
+        printf("the movie was recorded on another rom\n");
+        return -1;
+    }
+    return 0;
+}
+
+static uint8_t poll_movie(input_source *source, uint64_t frame) {
+    return frame < source->frames ? ((const uint8_t *) source->context)[frame] : 0;
+}
+
+input_source movie_input(const movie *m) {
+    return {poll_movie, (void *) m->buttons, m->frames};
+}
+
+static int load_keyframe(movie *m, uint64_t k, gameboy *gb) {
+    const movie_keyframe *key = &m->keyframes[k];
+    size_t n = state_size();
+    uint8_t *state = (uint8_t *) calloc(1, n);
+    uint8_t *code = (uint8_t *) malloc(key->size > 0 ? key->size : 1);
+    int result = -1;
+    if (state != NULL && code != NULL && read_at(m->fp, key->offset, code, key->size) == 0 &&
+        apply_delta(state, n, code, key->size) == 0 && load_state(gb, state, n) == 0)
+        result = state_hash(gb) == key->hash ? 0 : -1;
+    if (result)
+        printf("bad keyframe at frame %llu\n", (unsigned long long) key->frame);
+    free(state);
+    free(code);
+    return result;
+}
+
+//keyframes at or before frame
+static uint64_t keyframes_until(const movie *m, uint64_t frame) {
+    uint64_t low = 0, high = m->keyframe_count;
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        if (m->keyframes[middle].frame <= frame)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+int movie_seek(movie *m, gameboy *gb, const rom *r, uint64_t frame) {
+    uint64_t k = keyframes_until(m, frame);
+    uint64_t start = 0;
+    if (k > 0) {
+        if (load_keyframe(m, k - 1, gb))
+            return -1;
+        //the keyframe was taken before the lcd update that ends every frame
+        lcd_update(gb);
+        start = m->keyframes[k - 1].frame;
+    } else
+        machine_init(gb, r);
+    input_source source = movie_input(m);
+    for (uint64_t f = start; f < frame; f++) {
+        set_joypad(gb, source.poll(&source, f));
+        run_frame(gb, 0);
+    }
+    set_joypad(gb, source.poll(&source, frame));
+    return 0;
+}
+
+int movie_check(movie *m, gameboy *gb, uint64_t frame, char *where, size_t size) {
+    uint64_t k = keyframes_until(m, frame);
+    if (k == 0 || m->keyframes[k - 1].frame != frame)
+        return 0;
+    if (state_hash(gb) == m->keyframes[k - 1].hash)
+        return 1;
+    //the keyframe goes in an instance of its own to find the first difference
+    snprintf(where, size, "-");
+    gameboy *key = create_gameboy();
+    if (key != NULL) {
+        machine_init(key, gb->cart);
+        if (load_keyframe(m, k - 1, key) == 0)
+            state_difference(gb, key, where, size);
+        destroy_gameboy(key);
+    }
+    return -1;
+}
+
+static void free_recorder(movie_recorder *recorder) {
+    free(recorder->input);
+    free(recorder->keyframes);
+    free(recorder->state);
+    free(recorder->zero);
+    free(recorder->code);
+    free(recorder);
+}
+
+movie_recorder *create_movie_recorder(const char *path, const rom *r, gameboy *gb, uint32_t keyframe_interval) {
+    movie_recorder *recorder = (movie_recorder *) calloc(1, sizeof(movie_recorder));
+    if (recorder == NULL)
+        return NULL;
+    if (gb == NULL)
+        keyframe_interval = 0;
+    recorder->header = {MOVIE_MAGIC, MOVIE_VERSION, keyframe_interval, rom_hash(r), 0, 0, 0, 0, 0};
+    if (keyframe_interval > 0) {
+        size_t n = state_size();
+        recorder->gb = gb;
+        recorder->state = (uint8_t *) malloc(n);
+        recorder->zero = (uint8_t *) calloc(1, n);
+        recorder->code = (uint8_t *) malloc(DELTA_CODE_BOUND(n));
+        if (recorder->state == NULL || recorder->zero == NULL || recorder->code == NULL) {
+            free_recorder(recorder);
+            return NULL;
+        }
+    }
+    if ((recorder->fp = fopen(path, "wb")) == NULL) {
+        printf("cannot open %s\n", path);
+        free_recorder(recorder);
+        return NULL;
+    }
+    //the header is written again with the counts and offsets when the recorder is closed
+    fwrite(&recorder->header, sizeof(movie_header), 1, recorder->fp);
+    return recorder;
+}
+
+//room for needed items of item bytes, -1 if out of memory
+static int reserve(void **data, uint64_t *capacity, uint64_t needed, size_t item) {
+    if (needed <= *capacity)
+        return 0;
+    uint64_t size = *capacity > 0 ? *capacity : 256;
+    while (size < needed)
+        size *= 2;
+    void *grown = realloc(*data, size * item);
+    if (grown == NULL)
+        return -1;
+    *data = grown;
+    *capacity = size;
+    return 0;
+}
+
+static void write_run(movie_recorder *recorder) {
+    if (reserve((void **) &recorder->input, &recorder->input_capacity, recorder->header.input_size + 11, 1)) {
+        recorder->failed = 1;
+        return;
+    }
+    uint8_t *start = recorder->input + recorder->header.input_size, *p = start;
+    *p++ = recorder->buttons;
+    uint64_t value = recorder->run - 1;
+    while (value >= 0x80) {
+        *p++ = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t) value;
+    recorder->header.input_size += p - start;
+}
+
+void movie_record(movie_recorder *recorder, uint8_t buttons) {
+    if (recorder->run > 0 && buttons != recorder->buttons) {
+        write_run(recorder);
+        recorder->run = 0;
+    }
+    recorder->buttons = buttons;
+    recorder->run++;
+    recorder->header.frames++;
+}
+
+//the state of the recorded instance, appended to the file
+static void write_keyframe(movie_recorder *recorder, uint64_t frame) {
+    uint64_t count = recorder->header.keyframe_count;
+    if (reserve((void **) &recorder->keyframes, &recorder->keyframe_capacity, count + 1, sizeof(movie_keyframe))) {
+        recorder->failed = 1;
+        return;
+    }
+    size_t n = state_size();
+    save_state(recorder->gb, recorder->state);
+    size_t size = encode_delta(recorder->zero, recorder->state, n, recorder->code);
+    uint64_t offset = ftell(recorder->fp);
+    fwrite(recorder->code, 1, size, recorder->fp);
+    recorder->keyframes[count] = {frame, offset, (uint32_t) size, 0, state_hash(recorder->gb)};
+    recorder->header.keyframe_count++;
+}
+
+int close_movie_recorder(movie_recorder *recorder) {
+    if (recorder == NULL)
+        return 0;
+    if (recorder->run > 0)
+        write_run(recorder);
+    movie_header *h = &recorder->header;
+    h->input_offset = ftell(recorder->fp);
+    fwrite(recorder->input, 1, h->input_size, recorder->fp);
+    h->index_offset = ftell(recorder->fp);
+    fwrite(recorder->keyframes, sizeof(movie_keyframe), h->keyframe_count, recorder->fp);
+    fseek(recorder->fp, 0, SEEK_SET);
+    fwrite(h, sizeof(movie_header), 1, recorder->fp);
+    int failed = recorder->failed || ferror(recorder->fp) != 0;
+    failed |= fclose(recorder->fp) != 0;
+    if (failed)
+        printf("cannot write the movie\n");
+    free_recorder(recorder);
+    return failed ? -1 : 0;
+}
+
+static uint8_t poll_recording(input_source *source, uint64_t frame) {
+    movie_recorder *recorder = (movie_recorder *) source->context;
+    if (recorder->gb != NULL && frame > 0 && frame % recorder->header.keyframe_interval == 0)
+        write_keyframe(recorder, frame);
+    uint8_t buttons = recorder->inner->poll(recorder->inner, frame);
+    movie_record(recorder, buttons);
+    return buttons;
+}
+
+input_source recording_input(movie_recorder *recorder, input_source *inner) {
+    recorder->inner = inner;
+    return {poll_recording, recorder, inner->frames};
+}
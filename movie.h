@@ -0,0 +1,118 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include "gb.h"
+
+//joypad input: every frame takes its buttons from an input source, the sdl keyboard (main.cpp), a movie or a
+//raw input file, and a recorder can sit in front of any source to write what it gives to a movie
+//the buttons are set at the end of every frame for the next one, the same way everywhere, so the same rom and
+//the same movie replay bit exactly from power on
+
+//movie file: a header, the keyframes, the buttons of every frame run length coded and the keyframe index
+//a run is the button byte followed by a varint of its length - 1, a minute of idle input is 3 bytes
+//a keyframe is the savestate taken when the input of a frame is polled, right after the end_frame of the frame
+//before, every keyframe_interval frames, in the rewind delta code (rewind.h) against zero and with its state_hash
+//(statehash.h), the index gives the frame, place and hash of each, so a seek loads the keyframe before the frame
+//and runs at most an interval
+//version 1 files have no keyframes and their runs right after the first 40 bytes of the header
+#define MOVIE_MAGIC 0x4549564F4D424755ull //"UGBMOVIE" little endian
+#define MOVIE_VERSION 2
+#define MOVIE_V1_HEADER 40
+
+typedef struct movie_header {
+    uint64_t magic;
+    uint32_t version;
+    //frames between two keyframes, 0 without keyframes
+    uint32_t keyframe_interval;
+    //rom_hash of the rom it was recorded on
+    uint64_t rom_hash;
+    uint64_t frames;
+    //bytes of run code
+    uint64_t input_size;
+    //from the start of the file
+    uint64_t input_offset;
+    uint64_t index_offset;
+    uint64_t keyframe_count;
+} movie_header;
+
+//index entry
+typedef struct movie_keyframe {
+    uint64_t frame;
+    uint64_t offset;
+    uint32_t size;
+    uint32_t unused;
+    uint64_t hash;
+} movie_keyframe;
+
+//a decoded movie, one button byte per frame, the keyframes stay in the file and are read when needed
+typedef struct movie {
+    //0 for a raw input file, it plays on any rom
+    uint64_t rom_hash;
+    uint64_t frames;
+    uint8_t *buttons;
+    uint32_t keyframe_interval;
+    uint64_t keyframe_count;
+    movie_keyframe *keyframes;
+    //open while there are keyframes
+    FILE *fp;
+} movie;
+
+typedef struct input_source input_source;
+struct input_source {
+    //buttons of frame, see JOYPAD_ masks
+    uint8_t (*poll)(input_source *source, uint64_t frame);
+    void *context;
+    //frames it has input for, no button is pressed past them, UINT64_MAX for a live source
+    uint64_t frames;
+};
+
+typedef struct movie_recorder {
+    FILE *fp;
+    movie_header header;
+    //run being extended
+    uint8_t buttons;
+    uint64_t run;
+    //run code, written after the keyframes when the recorder is closed
+    uint8_t *input;
+    uint64_t input_capacity;
+    //the source being recorded
+    input_source *inner;
+    //instance the keyframes are taken from, NULL for none
+    gameboy *gb;
+    movie_keyframe *keyframes;
+    uint64_t keyframe_capacity;
+    uint8_t *state;
+    uint8_t *zero;
+    uint8_t *code;
+    //a write or an allocation failed, the movie is broken
+    uint8_t failed;
+} movie_recorder;
+
+//hash of the whole rom image
+uint64_t rom_hash(const rom *r);
+//load a movie, or a raw input file with one button byte per frame, 0 on success
+int load_movie(movie *m, const char *path);
+void free_movie(movie *m);
+//0 if m can play on r
+int check_movie(const movie *m, const rom *r);
+//source playing the buttons of m, m has to outlive it
+input_source movie_input(const movie *m);
+//bring gb, running r, to the start of frame with its input set: from the keyframe before it, or from power on,
+//then running the frames in between, 0 on success, -1 if the keyframe is broken and does not give its hash
+int movie_seek(movie *m, gameboy *gb, const rom *r, uint64_t frame);
+//compare gb where the input of frame is polled with the keyframe of that frame,
+//1 if they are the same, 0 if there is no keyframe there, -1 with the first difference in where if they are not
+int movie_check(movie *m, gameboy *gb, uint64_t frame, char *where, size_t size);
+
+//start a movie of inputs on r, with a keyframe of gb every keyframe_interval frames when gb is not NULL and
+//the interval is not 0, NULL on error
+movie_recorder *create_movie_recorder(const char *path, const rom *r, gameboy *gb, uint32_t keyframe_interval);
+//append the buttons of the next frame
+void movie_record(movie_recorder *recorder, uint8_t buttons);
+//write the run code, the index and the header, 0 on success
+int close_movie_recorder(movie_recorder *recorder);
+//source giving the buttons of inner and recording them, frames have to be polled in order at the start of
+//each frame, that is where the keyframes are taken
+input_source recording_input(movie_recorder *recorder, input_source *inner);
+
+#endif
@@ -0,0 +1,217 @@
+#include <new>
+#include "rewind.h"
+#include "savestate.h"
+
+static uint8_t *put_varint(uint8_t *p, size_t value) {
+    while (value >= 0x80) {
+        *p++ = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t) value;
+    return p;
+}
+
+//SIZE_MAX if the varint runs past end
+static size_t get_varint(const uint8_t **p, const uint8_t *end) {
+    size_t value = 0;
+    int shift = 0;
+    uint8_t byte;
+    do {
+        if (*p == end || shift > 63)
+            return SIZE_MAX;
+        byte = *(*p)++;
+        value |= (size_t) (byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return value;
+}
+
+static inline uint64_t load_word(const uint8_t *p) {
+    uint64_t word;
+    memcpy(&word, p, REWIND_WORD);
+    return word;
+}
+
+//64 bytes of a and b are the same
+static inline int line_equal(const uint8_t *a, const uint8_t *b) {
+    __m128i d0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) a), _mm_loadu_si128((const __m128i *) b));
+    __m128i d1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (a + 16)), _mm_loadu_si128((const __m128i *) (b + 16)));
+    __m128i d2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (a + 32)), _mm_loadu_si128((const __m128i *) (b + 32)));
+    __m128i d3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (a + 48)), _mm_loadu_si128((const __m128i *) (b + 48)));
+    __m128i d = _mm_or_si128(_mm_or_si128(d0, d1), _mm_or_si128(d2, d3));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(d, _mm_setzero_si128())) == 0xFFFF;
+}
+
+size_t encode_delta(const uint8_t *a, const uint8_t *b, size_t size, uint8_t *out) {
+    size_t n = size / REWIND_WORD;
+    size_t i = 0;
+    uint8_t *p = out;
+    while (i < n) {
+        size_t start = i;
+        //unchanged memory is skipped a cache line at a time
+        while (i + 8 <= n && line_equal(a + i * REWIND_WORD, b + i * REWIND_WORD))
+            i += 8;
+        while (i < n && load_word(a + i * REWIND_WORD) == load_word(b + i * REWIND_WORD))
+            i++;
+        size_t skip = i - start;
+        start = i;
+        while (i < n && load_word(a + i * REWIND_WORD) != load_word(b + i * REWIND_WORD))
+            i++;
+        p = put_varint(p, skip);
+        p = put_varint(p, i - start);
+        for (size_t k = start; k < i; k++) {
+            uint64_t d = load_word(a + k * REWIND_WORD) ^ load_word(b + k * REWIND_WORD);
+            memcpy(p, &d, REWIND_WORD);
+            p += REWIND_WORD;
+        }
+    }
+    return p - out;
+}
+
+int apply_delta(uint8_t *state, size_t state_size, const uint8_t *code, size_t size) {
+    const uint8_t *end = code + size;
+    size_t words = state_size / REWIND_WORD, at = 0;
+    while (code < end) {
+        size_t skip = get_varint(&code, end);
+        size_t changed = get_varint(&code, end);
+        if (skip > words - at || changed > words - at - skip || changed > (size_t) (end - code) / REWIND_WORD)
+            return -1;
+        uint8_t *p = state + (at + skip) * REWIND_WORD;
+        for (size_t k = 0; k < changed; k++) {
+            uint64_t word = load_word(p) ^ load_word(code);
+            memcpy(p, &word, REWIND_WORD);
+            p += REWIND_WORD;
+            code += REWIND_WORD;
+        }
+        at += skip + changed;
+    }
+    return 0;
+}
+
+rewind_buffer *create_rewind(size_t budget, uint32_t max_frames, uint32_t keyframe_interval) {
+    if (budget == 0 || max_frames == 0)
+        return NULL;
+    rewind_buffer *r = new (std::nothrow) rewind_buffer();
+    if (r == NULL)
+        return NULL;
+    size_t size = state_size();
+    r->capacity = budget;
+    r->max_frames = max_frames;
+    r->keyframe_interval = keyframe_interval > 0 ? keyframe_interval : 1;
+    r->data = (uint8_t *) malloc(budget);
+    r->entries = (rewind_entry *) malloc(max_frames * sizeof(rewind_entry));
+    r->state = (uint8_t *) malloc(size);
+    r->next = (uint8_t *) malloc(size);
+    r->zero = (uint8_t *) calloc(1, size);
+    r->code = (uint8_t *) malloc(DELTA_CODE_BOUND(size));
+    if (r->data == NULL || r->entries == NULL || r->state == NULL || r->next == NULL || r->zero == NULL ||
+        r->code == NULL) {
+        destroy_rewind(r);
+        return NULL;
+    }
+    rewind_clear(r);
+    return r;
+}
+
+void destroy_rewind(rewind_buffer *r) {
+    if (r == NULL)
+        return;
+    free(r->data);
+    free(r->entries);
+    free(r->state);
+    free(r->next);
+    free(r->zero);
+    free(r->code);
+    delete r;
+}
+
+void rewind_clear(rewind_buffer *r) {
+    r->head = 0;
+    r->used = 0;
+    r->first = 0;
+    r->count = 0;
+    r->since_key = 0;
+}
+
+static rewind_entry *entry(rewind_buffer *r, uint32_t i) {
+    return &r->entries[(r->first + i) % r->max_frames];
+}
+
+//drop the oldest keyframe and the deltas built on it
+static void drop_oldest(rewind_buffer *r) {
+    do {
+        r->used -= entry(r, 0)->size;
+        r->first = (r->first + 1) % r->max_frames;
+        r->count--;
+    } while (r->count > 0 && !entry(r, 0)->key);
+    if (r->count == 0)
+        rewind_clear(r);
+}
+
+//make room for size bytes and return where they go
+static size_t place(rewind_buffer *r, size_t size) {
+    size_t offset = r->head;
+    if (offset + size > r->capacity) {
+        //the end of the ring is too short, everything past the head is older than what is at the start
+        while (r->count > 0 && entry(r, 0)->offset >= r->head)
+            drop_oldest(r);
+        offset = 0;
+    }
+    while (r->count > 0 && (r->count == r->max_frames ||
+                            (entry(r, 0)->offset < offset + size && offset < entry(r, 0)->offset + entry(r, 0)->size)))
+        drop_oldest(r);
+    return r->count > 0 ? offset : 0;
+}
+
+int rewind_capture(rewind_buffer *r, gameboy *gb) {
+    size_t n = state_size();
+    save_state(gb, r->next);
+    int key = r->count == 0 || r->since_key + 1 >= r->keyframe_interval;
+    size_t size, offset;
+    for (;;) {
+        size = encode_delta(key ? r->zero : r->state, r->next, n, r->code);
+        if (size > r->capacity) {
+            rewind_clear(r);
+            return -1;
+        }
+        offset = place(r, size);
+        //a delta whose keyframe was dropped to make room is coded again as a keyframe
+        if (key || r->count > 0)
+            break;
+        key = 1;
+    }
+    memcpy(r->data + offset, r->code, size);
+    *entry(r, r->count) = {(uint32_t) offset, (uint32_t) size, (uint8_t) key};
+    r->count++;
+    r->head = offset + size;
+    r->used += size;
+    r->since_key = key ? 0 : r->since_key + 1;
+    uint8_t *state = r->state;
+    r->state = r->next;
+    r->next = state;
+    return 0;
+}
+
+int rewind_step(rewind_buffer *r, gameboy *gb) {
+    if (r->count < 2)
+        return -1;
+    size_t n = state_size();
+    rewind_entry last = *entry(r, r->count - 1);
+    if (!last.key) {
+        apply_delta(r->state, n, r->data + last.offset, last.size);
+        r->since_key--;
+    } else {
+        //the frame before a keyframe is rebuilt from the keyframe before it
+        uint32_t k = r->count - 2;
+        while (!entry(r, k)->key)
+            k--;
+        memset(r->state, 0, n);
+        for (uint32_t i = k; i < r->count - 1; i++)
+            apply_delta(r->state, n, r->data + entry(r, i)->offset, entry(r, i)->size);
+        r->since_key = r->count - 2 - k;
+    }
+    r->count--;
+    r->used -= last.size;
+    r->head = last.offset;
+    return load_state(gb, r->state, n);
+}
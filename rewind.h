@@ -0,0 +1,65 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "gb.h"
+
+//rewind buffer: one savestate per frame, kept as xor deltas against the frame before,
+//with a full keyframe every keyframe_interval frames, all of them run length coded into a byte ring of a fixed budget
+//stepping back applies the newest delta to the newest state, a keyframe is reached again from the keyframe before it
+//when the budget is full the oldest keyframe goes together with the deltas that depend on it
+
+//the delta code works on 8 byte words: pairs of varints (unchanged words, changed words) each followed by the changed words
+#define REWIND_WORD 8
+//every run of changed words costs at most two varints of 3 bytes, and there is one per changed word at worst
+#define DELTA_CODE_BOUND(size) ((size) + (size) / REWIND_WORD * 6 + 16)
+
+typedef struct rewind_entry {
+    //in the byte ring
+    uint32_t offset;
+    uint32_t size;
+    uint8_t key;
+} rewind_entry;
+
+typedef struct rewind_buffer {
+    uint8_t *data;
+    size_t capacity;
+    //end of the newest entry in data
+    size_t head;
+    //bytes of the live entries
+    size_t used;
+    rewind_entry *entries;
+    uint32_t max_frames;
+    uint32_t first;
+    uint32_t count;
+    uint32_t keyframe_interval;
+    //deltas since the newest keyframe
+    uint32_t since_key;
+    //newest state, the one before it is built here when stepping back
+    uint8_t *state;
+    //the next state is saved here
+    uint8_t *next;
+    //all zero, keyframes are coded against it
+    uint8_t *zero;
+    //an entry is coded here before it is copied to the ring, the worst case fits
+    uint8_t *code;
+} rewind_buffer;
+
+//budget bytes of coded frames, at most max_frames of them, NULL if out of memory
+rewind_buffer *create_rewind(size_t budget, uint32_t max_frames, uint32_t keyframe_interval);
+void destroy_rewind(rewind_buffer *r);
+//drop every frame
+void rewind_clear(rewind_buffer *r);
+//push the state of gb, called once per frame, -1 if the state alone does not fit the budget
+int rewind_capture(rewind_buffer *r, gameboy *gb);
+//drop the newest frame and load the one before it into gb, -1 if there is none
+int rewind_step(rewind_buffer *r, gameboy *gb);
+
+//the delta code alone, movies (movie.h) keep their keyframes in it coded against zero
+//code b xor a into out, which holds DELTA_CODE_BOUND(size) bytes, size is a multiple of REWIND_WORD,
+//returns the bytes written
+size_t encode_delta(const uint8_t *a, const uint8_t *b, size_t size, uint8_t *out);
+//xor a coded delta into state, which then holds the other side of the delta, -1 if the code is broken or
+//goes past state_size bytes
+int apply_delta(uint8_t *state, size_t state_size, const uint8_t *code, size_t size);
+
+#endif
@@ -0,0 +1,109 @@
+#include <new>
+#include <chrono>
+#include "runahead.h"
+
+typedef std::chrono::steady_clock runahead_clock;
+
+//n frames of the fork, the last one drawn
+static void run_ahead(runahead *r, uint32_t n) {
+    r->ahead->output = r->output;
+    for (uint32_t i = 0; i < n; i++)
+        run_frame(r->ahead, i + 1 == n);
+    r->ahead->output = NULL;
+}
+
+static void run_worker(runahead *r) {
+    std::unique_lock<std::mutex> guard(r->lock);
+    while (true) {
+        r->wake.wait(guard, [r] { return r->pending > 0 || r->stop; });
+        if (r->pending == 0)
+            return;
+        guard.unlock();
+        run_ahead(r, r->pending);
+        guard.lock();
+        r->pending = 0;
+        r->done.notify_one();
+    }
+}
+
+runahead *create_runahead(uint32_t frames, int threaded) {
+    if (frames == 0)
+        return NULL;
+    runahead *r = new (std::nothrow) runahead();
+    if (r == NULL)
+        return NULL;
+    if ((r->ahead = create_gameboy()) == NULL) {
+        delete r;
+        return NULL;
+    }
+    r->frames = frames;
+    r->threaded = threaded;
+    if (threaded)
+        r->worker = std::thread(run_worker, r);
+    return r;
+}
+
+void destroy_runahead(runahead *r) {
+    if (r == NULL)
+        return;
+    if (r->worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(r->lock);
+            r->stop = 1;
+        }
+        r->wake.notify_one();
+        r->worker.join();
+    }
+    destroy_gameboy(r->ahead);
+    delete r;
+}
+
+void runahead_start(runahead *r, gameboy *gb, const render_target *output) {
+    auto start = runahead_clock::now();
+    if (r->lead == 0 || gb->joypad != r->buttons) {
+        //forked at the frame boundary, before the lcd update that ends every frame
+        if (fork_gameboy(gb, r->ahead) != 0) {
+            r->lead = 0;
+            return;
+        }
+        r->ahead->verbose = 0;
+        lcd_update(r->ahead);
+        r->buttons = gb->joypad;
+        r->lead = 0;
+        r->forks++;
+    }
+    //the frame shown comes frames frames after the real frame about to run
+    uint32_t n = r->frames + 1 - r->lead;
+    r->lead = r->frames + 1;
+    r->output = output;
+    r->running = 1;
+    r->started++;
+    r->speculative_frames += n;
+    if (r->threaded) {
+        {
+            std::lock_guard<std::mutex> guard(r->lock);
+            r->pending = n;
+        }
+        r->wake.notify_one();
+    } else
+        run_ahead(r, n);
+    r->wait_seconds += std::chrono::duration<double>(runahead_clock::now() - start).count();
+}
+
+void runahead_finish(runahead *r) {
+    if (!r->running)
+        return;
+    auto start = runahead_clock::now();
+    if (r->threaded) {
+        std::unique_lock<std::mutex> guard(r->lock);
+        r->done.wait(guard, [r] { return r->pending == 0; });
+    }
+    //the real frame has run
+    r->lead--;
+    r->running = 0;
+    r->wait_seconds += std::chrono::duration<double>(runahead_clock::now() - start).count();
+}
+
+double runahead_saved_ms(const runahead *r) {
+    return r->frames * (FRAME_CYCLES * 1000.0 / CPU_CLOCK);
+}
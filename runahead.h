@@ -0,0 +1,56 @@
+#ifndef RUNAHEAD_H
+#define RUNAHEAD_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "gb.h"
+
+//run-ahead: the frame shown is the one frames frames after the real one, as if the buttons stayed held for them,
+//so a game that reacts to the joypad a few frames late shows it on the frame it is pressed
+//the real instance never runs ahead, the speculative frames run on a fork of it (fork_gameboy), which is the
+//savestate and its restore in one, with only the last one drawn
+//the fork stays right while the buttons do not change, then it only runs one more frame per real frame, it is
+//forked again and runs frames + 1 frames when they change
+//threaded, the fork runs on a second thread, next to the real frame on another core
+//the fork follows the real instance frame by frame, nothing else may change it while run-ahead is on, so the
+//frontends turn rewind off with it
+
+typedef struct runahead {
+    uint32_t frames;
+    gameboy *ahead;
+    //ahead is the real instance held lead frames further with buttons, no fork yet when it is 0
+    uint32_t lead;
+    uint8_t buttons;
+    //where the last speculative frame is drawn, and the frames it still has to run
+    const render_target *output;
+    uint32_t pending;
+    //started and not finished
+    int running;
+
+    int threaded;
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    int stop;
+
+    //frames run, forks, and time the real frame waited for them
+    uint64_t started;
+    uint64_t speculative_frames;
+    uint64_t forks;
+    double wait_seconds;
+} runahead;
+
+//frames ahead, at least 1, NULL on error
+runahead *create_runahead(uint32_t frames, int threaded);
+void destroy_runahead(runahead *r);
+//start the speculative frames from gb, called at the frame boundary once its buttons are set, the frame after
+//them is drawn into output, NULL for the framebuffer of the fork
+void runahead_start(runahead *r, gameboy *gb, const render_target *output);
+//wait for the frames started, called before the real frame is shown, output then holds the frame to show
+void runahead_finish(runahead *r);
+//input latency hidden, in milliseconds
+double runahead_saved_ms(const runahead *r);
+
+#endif
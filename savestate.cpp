@@ -0,0 +1,210 @@
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "savestate.h"
+
+//section table of every state, filled once
+typedef struct state_layout {
+    state_section section[STATE_SECTION_COUNT];
+    uint64_t size;
+} state_layout;
+
+static uint64_t align_state(uint64_t offset) {
+    return (offset + STATE_ALIGN - 1) & ~(uint64_t) (STATE_ALIGN - 1);
+}
+
+static state_layout make_layout() {
+    state_layout l;
+    const uint32_t tags[STATE_SECTION_COUNT] = {STATE_CPU, STATE_ROM, STATE_MEM, STATE_VRAM, STATE_OAM, STATE_PPU};
+    const uint32_t sizes[STATE_SECTION_COUNT] = {sizeof(state_cpu), sizeof(state_rom), 0x10000, 0x2000, 0xA0, 0xc};
+    uint64_t offset = align_state(sizeof(state_header) + sizeof(l.section));
+    for (int i = 0; i < STATE_SECTION_COUNT; i++) {
+        l.section[i] = {tags[i], sizes[i], offset};
+        offset = align_state(offset + sizes[i]);
+    }
+    l.size = offset;
+    return l;
+}
+
+static const state_layout layout = make_layout();
+
+size_t state_size() {
+    return layout.size;
+}
+
+void save_cpu_state(gameboy *gb, state_cpu *out) {
+    state_cpu cpu = {};
+    cpu.AF = gb->reg.AF;
+    cpu.BC = gb->reg.BC;
+    cpu.DE = gb->reg.DE;
+    cpu.HL = gb->reg.HL;
+    cpu.SP = gb->reg.SP;
+    cpu.PC = gb->reg.PC;
+    cpu.ime = gb->reg.ime;
+    cpu.joypad = gb->joypad;
+    cpu.last_amount_cycles = gb->last_amount_cycles;
+    cpu.frame_counter = gb->frame_counter;
+    cpu.offset = gb->offset;
+    cpu.wannadie = gb->wannadie;
+    cpu.bank_address = gb->bank_address;
+    cpu.total_cycles = gb->total_cycles;
+    cpu.total_instructions = gb->total_instructions;
+    *out = cpu;
+}
+
+void save_state(gameboy *gb, uint8_t *out) {
+    //the gaps are zeroed so equal machines give equal bytes
+    memset(out, 0, layout.section[0].offset);
+    state_header h = {STATE_MAGIC, STATE_VERSION, STATE_SECTION_COUNT, layout.size};
+    memcpy(out, &h, sizeof(h));
+    memcpy(out + sizeof(h), layout.section, sizeof(layout.section));
+
+    state_cpu cpu;
+    save_cpu_state(gb, &cpu);
+    state_rom r = {};
+    memcpy(r.title, gb->header.title, sizeof(r.title));
+    r.header_checksum = gb->header.header_checksum;
+    memcpy(r.global_checksum, gb->header.global_checksum, 2);
+    r.size = gb->cart->size;
+
+    //memory goes page by page, pages of a fork are not in gb->memory
+    const void *data[STATE_SECTION_COUNT] = {&cpu, &r, NULL, gb->vram, gb->oam, gb->ppu_registers};
+    for (int i = 0; i < STATE_SECTION_COUNT; i++) {
+        const state_section &s = layout.section[i];
+        uint64_t end = i + 1 < STATE_SECTION_COUNT ? layout.section[i + 1].offset : layout.size;
+        if (s.tag == STATE_MEM) {
+            for (int n = 0; n < PAGE_COUNT; n++)
+                memcpy(out + s.offset + n * PAGE_SIZE, gb->mem[n], PAGE_SIZE);
+        } else
+            memcpy(out + s.offset, data[i], s.size);
+        memset(out + s.offset + s.size, 0, end - s.offset - s.size);
+    }
+}
+
+//section tag of a state, NULL if it is missing or does not fit
+static const uint8_t *find_section(const uint8_t *data, size_t size, uint32_t tag, uint32_t length) {
+    const state_header *h = (const state_header *) data;
+    const state_section *table = (const state_section *) (data + sizeof(state_header));
+    if (sizeof(state_header) + (uint64_t) h->section_count * sizeof(state_section) > size)
+        return NULL;
+    for (uint32_t i = 0; i < h->section_count; i++) {
+        if (table[i].tag == tag)
+            //offset comes from the file, compared without adding to it so a huge one cannot wrap around
+            return table[i].size == length && length <= size && table[i].offset <= size - length ?
+                   data + table[i].offset : NULL;
+    }
+    return NULL;
+}
+
+int load_state(gameboy *gb, const uint8_t *data, size_t size) {
+    state_header h;
+    if (size < sizeof(h))
+        return -1;
+    memcpy(&h, data, sizeof(h));
+    if (h.magic != STATE_MAGIC || h.version != STATE_VERSION || h.size > size)
+        return -1;
+    const uint8_t *cpu_data = find_section(data, size, STATE_CPU, sizeof(state_cpu));
+    const uint8_t *rom_data = find_section(data, size, STATE_ROM, sizeof(state_rom));
+    const uint8_t *memory = find_section(data, size, STATE_MEM, 0x10000);
+    const uint8_t *vram = find_section(data, size, STATE_VRAM, 0x2000);
+    const uint8_t *oam = find_section(data, size, STATE_OAM, 0xA0);
+    const uint8_t *ppu = find_section(data, size, STATE_PPU, 0xc);
+    if (cpu_data == NULL || rom_data == NULL || memory == NULL || vram == NULL || oam == NULL || ppu == NULL)
+        return -1;
+    state_cpu cpu;
+    state_rom r;
+    memcpy(&cpu, cpu_data, sizeof(cpu));
+    memcpy(&r, rom_data, sizeof(r));
+    if (memcmp(r.title, gb->header.title, sizeof(r.title)) != 0 || r.header_checksum != gb->header.header_checksum ||
+        memcmp(r.global_checksum, gb->header.global_checksum, 2) != 0 || r.size != gb->cart->size ||
+        cpu.bank_address > gb->cart->size - 0x4000) {
+        if (gb->verbose)
+            printf("state was saved with another rom\n");
+        return -1;
+    }
+
+    gb->reg.AF = cpu.AF;
+    gb->reg.BC = cpu.BC;
+    gb->reg.DE = cpu.DE;
+    gb->reg.HL = cpu.HL;
+    gb->reg.SP = cpu.SP;
+    gb->reg.PC = cpu.PC;
+    gb->reg.ime = cpu.ime;
+    gb->joypad = cpu.joypad;
+    gb->last_amount_cycles = cpu.last_amount_cycles;
+    gb->frame_counter = cpu.frame_counter;
+    gb->offset = cpu.offset;
+    gb->wannadie = cpu.wannadie;
+    gb->total_cycles = cpu.total_cycles;
+    gb->total_instructions = cpu.total_instructions;
+    release_shared(gb);
+    forget_state_hash(gb);
+    memcpy(gb->memory, memory, 0x10000);
+    memcpy(gb->vram, vram, 0x2000);
+    memcpy(gb->oam, oam, 0xA0);
+    memcpy(gb->ppu_registers, ppu, 0xc);
+    //fixup: the page tables point into this instance and the rom it runs
+    for (int i = 0; i < PAGE_COUNT; i++)
+        gb->page[i] = gb->mem[i];
+    map_rom_bank(gb, cpu.bank_address);
+    return 0;
+}
+
+//the state is built in the render scratch, which is free between frames
+int save_state_file(gameboy *gb, const char *path) {
+    arena_reset(&gb->scratch);
+    uint8_t *out = (uint8_t *) arena_alloc(&gb->scratch, state_size());
+    FILE *fp = fopen(path, "wb");
+    if (out == NULL || fp == NULL) {
+        printf("cannot write state %s\n", path);
+        if (fp != NULL)
+            fclose(fp);
+        return -1;
+    }
+    save_state(gb, out);
+    int err = fwrite(out, 1, state_size(), fp) != state_size();
+    err |= fclose(fp) != 0;
+    if (err)
+        printf("cannot write state %s\n", path);
+    return err ? -1 : 0;
+}
+
+int load_state_file(gameboy *gb, const char *path) {
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        printf("cannot open state %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("cannot map state %s\n", path);
+        return -1;
+    }
+    int err = load_state(gb, (const uint8_t *) data, st.st_size);
+    munmap(data, st.st_size);
+#else
+    arena_reset(&gb->scratch);
+    uint8_t *data = (uint8_t *) arena_alloc(&gb->scratch, state_size());
+    FILE *fp = fopen(path, "rb");
+    if (data == NULL || fp == NULL) {
+        printf("cannot open state %s\n", path);
+        if (fp != NULL)
+            fclose(fp);
+        return -1;
+    }
+    size_t size = fread(data, 1, state_size(), fp);
+    fclose(fp);
+    int err = load_state(gb, data, size);
+#endif
+    if (err)
+        printf("invalid state %s\n", path);
+    return err;
+}
@@ -0,0 +1,76 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include "gb.h"
+
+//savestates: a flat little endian image, a header, a table of sections and the sections themselves,
+//every section starts on a 64 byte boundary so a mapped file can be used in place
+//a loader skips the tags it does not know and fails on a missing one, version changes when a known section changes
+//the page table is not saved, it is rebuilt from bank_address when the state is loaded
+
+#define STATE_MAGIC 0x4554415453424755ull //"UGBSTATE" little endian
+#define STATE_VERSION 1
+#define STATE_ALIGN 64
+
+//section tags, four characters
+#define STATE_CPU  0x20555043 //"CPU "
+#define STATE_ROM  0x204D4F52 //"ROM "
+#define STATE_MEM  0x204D454D //"MEM "
+#define STATE_VRAM 0x4D415256 //"VRAM"
+#define STATE_OAM  0x204D414F //"OAM "
+#define STATE_PPU  0x20555050 //"PPU "
+#define STATE_SECTION_COUNT 6
+
+typedef struct state_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t section_count;
+    //bytes of the whole state
+    uint64_t size;
+} state_header;
+
+typedef struct state_section {
+    uint32_t tag;
+    uint32_t size;
+    //from the start of the state
+    uint64_t offset;
+} state_section;
+
+//registers, rom bank and counters
+typedef struct state_cpu {
+    uint16_t AF, BC, DE, HL, SP, PC;
+    uint8_t ime;
+    uint8_t joypad;
+    uint8_t unused[2];
+    uint32_t last_amount_cycles;
+    int32_t frame_counter;
+    int32_t offset;
+    int32_t wannadie;
+    uint32_t bank_address;
+    uint64_t total_cycles;
+    uint64_t total_instructions;
+} state_cpu;
+
+//the rom the state was saved with, a state only loads on the same rom
+typedef struct state_rom {
+    char title[16];
+    uint8_t header_checksum;
+    uint8_t global_checksum[2];
+    uint8_t unused;
+    uint32_t size;
+} state_rom;
+
+//bytes of a state, the same for every instance
+size_t state_size();
+//write the state of gb to out, which holds state_size() bytes
+void save_state(gameboy *gb, uint8_t *out);
+//the cpu section alone, unused bytes zeroed
+void save_cpu_state(gameboy *gb, state_cpu *out);
+//restore a state saved from the same rom, 0 on success, -1 if it is invalid and gb is left untouched
+int load_state(gameboy *gb, const uint8_t *data, size_t size);
+//one write of the whole state, 0 on success
+int save_state_file(gameboy *gb, const char *path);
+//map the file and load it, 0 on success
+int load_state_file(gameboy *gb, const char *path);
+
+#endif
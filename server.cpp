@@ -0,0 +1,402 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "gb.h"
+#include "server.h"
+#include "savestate.h"
+
+//session server, no sdl
+//usage: gbserver socket [--pool n] [--preload rom.gb]...
+//keeps a pool of instances created up front, roms are mapped once and shared by every session running them,
+//a free instance stays powered on with its last rom so the next session of that rom starts warm
+//one thread per connection, sessions belong to the connection that created them and close with it
+//the protocol is in server.h
+
+typedef std::chrono::steady_clock server_clock;
+
+typedef struct rom_entry {
+    char *path;
+    rom cart;
+} rom_entry;
+
+typedef struct pool_slot {
+    gameboy *gb;
+    //rom the instance is powered on with, NULL if none yet
+    const rom *cart;
+    //connection owning the session, 0 if free
+    uint64_t owner;
+    //the instance is freshly powered on
+    int warm;
+    uint64_t frames;
+} pool_slot;
+
+typedef struct pool_stats {
+    uint64_t sessions;
+    uint64_t warm_starts;
+    uint64_t cold_starts;
+    uint64_t exhausted;
+    uint64_t commands;
+    uint64_t frames;
+    uint32_t in_use;
+    uint32_t peak_in_use;
+    double create_us;
+} pool_stats;
+
+std::mutex pool_lock;
+std::vector<pool_slot> pool;
+std::vector<rom_entry> roms;
+pool_stats stats;
+std::atomic<uint64_t> next_connection;
+auto server_start = server_clock::now();
+
+//cached rom of path, NULL if it is not mapped yet, called with pool_lock held
+const rom *cached_rom(const char *path) {
+    for (rom_entry &e : roms)
+        if (strcmp(e.path, path) == 0)
+            return &e.cart;
+    return NULL;
+}
+
+//add a rom mapped outside the lock to the cache, called with pool_lock held
+//another session may have mapped the same path meanwhile, its entry is kept and this one dropped
+const rom *cache_rom(rom_entry e) {
+    const rom *cached = cached_rom(e.path);
+    //entries are never removed, reserve keeps the rom pointers of running sessions valid
+    if (cached == NULL && roms.size() == roms.capacity())
+        printf("rom cache full\n");
+    if (cached != NULL || roms.size() == roms.capacity()) {
+        free_rom(&e.cart);
+        free(e.path);
+        return cached;
+    }
+    roms.push_back(e);
+    return &roms.back().cart;
+}
+
+//mapped rom of path, every session of the same path shares it, NULL on error
+//guard holds pool_lock, it is let go while a rom that is not cached yet is mapped, so a slow disk only holds up
+//the connection asking for it
+const rom *find_rom(const char *path, std::unique_lock<std::mutex> &guard) {
+    const rom *cart = cached_rom(path);
+    if (cart != NULL)
+        return cart;
+    guard.unlock();
+    rom_entry e;
+    int err = map_rom_file(&e.cart, path);
+    if (!err && (e.path = strdup(path)) == NULL) {
+        free_rom(&e.cart);
+        err = 1;
+    }
+    guard.lock();
+    return err ? NULL : cache_rom(e);
+}
+
+//claim an instance for a new session: a warm one of the same rom, else any free one powered on again
+int acquire(const char *path, uint64_t owner, uint32_t *session) {
+    auto start = server_clock::now();
+    std::unique_lock<std::mutex> guard(pool_lock);
+    const rom *cart = find_rom(path, guard);
+    if (cart == NULL)
+        return SERVER_ROM_ERROR;
+    //best free instance: warm with this rom, then one not warm for another rom, then any
+    int found = -1, rank = 0;
+    for (size_t i = 0; i < pool.size() && rank < 3; i++) {
+        if (pool[i].owner != 0)
+            continue;
+        int r = pool[i].warm && pool[i].cart == cart ? 3 : !pool[i].warm ? 2 : 1;
+        if (r > rank) {
+            found = (int) i;
+            rank = r;
+        }
+    }
+    if (found < 0) {
+        stats.exhausted++;
+        return SERVER_POOL_EXHAUSTED;
+    }
+    pool_slot *slot = &pool[found];
+    slot->owner = owner;
+    stats.in_use++;
+    stats.peak_in_use = stats.in_use > stats.peak_in_use ? stats.in_use : stats.peak_in_use;
+    stats.sessions++;
+    int warm = slot->warm && slot->cart == cart;
+    if (warm)
+        stats.warm_starts++;
+    else
+        stats.cold_starts++;
+    slot->cart = cart;
+    slot->warm = 0;
+    slot->frames = 0;
+    guard.unlock();
+    if (!warm)
+        machine_init(slot->gb, cart);
+    *session = found;
+    double us = std::chrono::duration<double, std::micro>(server_clock::now() - start).count();
+    guard.lock();
+    stats.create_us += us;
+    return SERVER_OK;
+}
+
+//power the instance on again before it goes back, so the next session of the rom is warm
+void release(uint32_t session) {
+    pool_slot *slot = &pool[session];
+    machine_init(slot->gb, slot->cart);
+    slot->warm = 1;
+    std::lock_guard<std::mutex> guard(pool_lock);
+    slot->owner = 0;
+    stats.in_use--;
+}
+
+int read_full(int fd, void *buffer, size_t size) {
+    uint8_t *p = (uint8_t *) buffer;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n <= 0)
+            return -1;
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+int write_full(int fd, const void *buffer, size_t size) {
+    const uint8_t *p = (const uint8_t *) buffer;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n <= 0)
+            return -1;
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+int send_reply(int fd, int status, const void *payload, uint32_t length) {
+    server_reply reply = {length, (uint8_t) status, {}};
+    if (write_full(fd, &reply, sizeof(reply)))
+        return -1;
+    return length > 0 ? write_full(fd, payload, length) : 0;
+}
+
+int stats_json(char *json, size_t size) {
+    std::lock_guard<std::mutex> guard(pool_lock);
+    double uptime = std::chrono::duration<double>(server_clock::now() - server_start).count();
+    uint32_t warm = 0;
+    for (pool_slot &slot : pool)
+        warm += slot.owner == 0 && slot.warm;
+    return snprintf(json, size,
+                    "{\"pool\": %zu, \"in_use\": %u, \"peak_in_use\": %u, \"warm\": %u, \"utilization\": %.3f, "
+                    "\"sessions\": %llu, \"warm_starts\": %llu, \"cold_starts\": %llu, \"exhausted\": %llu, "
+                    "\"avg_create_us\": %.2f, \"commands\": %llu, \"frames\": %llu, \"roms\": %zu, \"uptime\": %.3f}",
+                    pool.size(), stats.in_use, stats.peak_in_use, warm, pool.empty() ? 0 : (double) stats.in_use / pool.size(),
+                    (unsigned long long) stats.sessions, (unsigned long long) stats.warm_starts,
+                    (unsigned long long) stats.cold_starts, (unsigned long long) stats.exhausted,
+                    stats.sessions > 0 ? stats.create_us / stats.sessions : 0, (unsigned long long) stats.commands,
+                    (unsigned long long) stats.frames, roms.size(), uptime);
+}
+
+//serve one connection until it closes, then close its sessions
+void serve(int fd) {
+    uint64_t owner = ++next_connection;
+    std::vector<uint8_t> payload;
+    std::vector<uint32_t> sessions;
+    server_request req;
+    while (read_full(fd, &req, sizeof(req)) == 0) {
+        if (req.length > SERVER_MAX_PAYLOAD)
+            break;
+        payload.resize(req.length + 1);
+        if (req.length > 0 && read_full(fd, payload.data(), req.length))
+            break;
+        int owned;
+        {
+            std::lock_guard<std::mutex> guard(pool_lock);
+            stats.commands++;
+            owned = req.session < pool.size() && pool[req.session].owner == owner;
+        }
+        gameboy *gb = owned ? pool[req.session].gb : NULL;
+        int err = 0;
+        switch (req.command) {
+            case SERVER_CREATE: {
+                payload[req.length] = 0;
+                uint32_t session;
+                int status = acquire((const char *) payload.data(), owner, &session);
+                if (status == SERVER_OK)
+                    sessions.push_back(session);
+                err = send_reply(fd, status, &session, status == SERVER_OK ? sizeof(session) : 0);
+                break;
+            }
+            case SERVER_CLOSE:
+                if (!owned) {
+                    err = send_reply(fd, SERVER_NO_SESSION, NULL, 0);
+                    break;
+                }
+                for (size_t i = 0; i < sessions.size(); i++) {
+                    if (sessions[i] == req.session) {
+                        sessions[i] = sessions.back();
+                        sessions.pop_back();
+                        break;
+                    }
+                }
+                release(req.session);
+                err = send_reply(fd, SERVER_OK, NULL, 0);
+                break;
+            case SERVER_STEP: {
+                step_request step;
+                if (!owned || req.length < sizeof(step)) {
+                    err = send_reply(fd, owned ? SERVER_BAD_REQUEST : SERVER_NO_SESSION, NULL, 0);
+                    break;
+                }
+                memcpy(&step, payload.data(), sizeof(step));
+                //a step holds its pool thread until it is done, a huge one would keep it from every other session
+                if (step.frames > SERVER_MAX_STEP_FRAMES) {
+                    err = send_reply(fd, SERVER_BAD_REQUEST, NULL, 0);
+                    break;
+                }
+                const uint8_t *inputs = payload.data() + sizeof(step);
+                uint32_t input_count = req.length - sizeof(step);
+                for (uint32_t f = 0; f < step.frames; f++) {
+                    set_joypad(gb, f < input_count ? inputs[f] : 0);
+                    run_frame(gb, step.render);
+                }
+                pool[req.session].frames += step.frames;
+                {
+                    std::lock_guard<std::mutex> guard(pool_lock);
+                    stats.frames += step.frames;
+                }
+                step_reply reply = {gb->total_cycles, gb->total_instructions, pool[req.session].frames, gb->reg.PC, {}};
+                err = send_reply(fd, SERVER_OK, &reply, sizeof(reply));
+                break;
+            }
+            case SERVER_READ: {
+                read_request rd;
+                if (!owned || req.length < sizeof(rd)) {
+                    err = send_reply(fd, owned ? SERVER_BAD_REQUEST : SERVER_NO_SESSION, NULL, 0);
+                    break;
+                }
+                memcpy(&rd, payload.data(), sizeof(rd));
+                if (rd.address + rd.length > 0x10000) {
+                    err = send_reply(fd, SERVER_BAD_REQUEST, NULL, 0);
+                    break;
+                }
+                payload.resize(rd.length);
+                for (uint32_t i = 0; i < rd.length; i++)
+                    payload[i] = read_memory(gb, rd.address + i);
+                err = send_reply(fd, SERVER_OK, payload.data(), rd.length);
+                break;
+            }
+            case SERVER_FRAME:
+                if (!owned)
+                    err = send_reply(fd, SERVER_NO_SESSION, NULL, 0);
+                else
+                    err = send_reply(fd, SERVER_OK, gb->framebuffer, sizeof(gb->framebuffer));
+                break;
+            case SERVER_STATS: {
+                char json[0x400];
+                int len = stats_json(json, sizeof(json));
+                err = send_reply(fd, SERVER_OK, json, len);
+                break;
+            }
+            case SERVER_LOAD:
+                if (!owned)
+                    err = send_reply(fd, SERVER_NO_SESSION, NULL, 0);
+                else
+                    err = send_reply(fd, load_state(gb, payload.data(), req.length) ? SERVER_BAD_REQUEST : SERVER_OK, NULL, 0);
+                break;
+            case SERVER_SAVE:
+                if (!owned) {
+                    err = send_reply(fd, SERVER_NO_SESSION, NULL, 0);
+                    break;
+                }
+                payload.resize(state_size());
+                save_state(gb, payload.data());
+                err = send_reply(fd, SERVER_OK, payload.data(), state_size());
+                break;
+            default:
+                err = send_reply(fd, SERVER_BAD_REQUEST, NULL, 0);
+                break;
+        }
+        if (err)
+            break;
+    }
+    for (uint32_t session : sessions)
+        release(session);
+    close(fd);
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    uint32_t pool_size = 64;
+    std::vector<const char *> preload;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--pool") == 0 && i + 1 < argc)
+            pool_size = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--preload") == 0 && i + 1 < argc)
+            preload.push_back(argv[++i]);
+        else if (argv[i][0] != '-' && path == NULL)
+            path = argv[i];
+        else {
+            printf("unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (path == NULL || pool_size == 0) {
+        printf("usage: gbserver socket [--pool n] [--preload rom.gb]...\n");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    roms.reserve(1024);
+    pool.resize(pool_size);
+    for (pool_slot &slot : pool) {
+        if ((slot.gb = create_gameboy()) == NULL)
+            return 1;
+        slot.gb->verbose = 0;
+    }
+    //preloaded roms split the pool between them, every instance already powered on
+    std::unique_lock<std::mutex> guard(pool_lock);
+    for (size_t i = 0; i < preload.size(); i++) {
+        const rom *cart = find_rom(preload[i], guard);
+        if (cart == NULL)
+            return 1;
+        for (size_t j = i; j < pool.size(); j += preload.size()) {
+            machine_init(pool[j].gb, cart);
+            pool[j].cart = cart;
+            pool[j].warm = 1;
+        }
+    }
+    guard.unlock();
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (listener < 0 || strlen(path) >= sizeof(addr.sun_path)) {
+        printf("cannot create socket %s\n", path);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(listener, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(listener, 64) != 0) {
+        printf("cannot listen on %s\n", path);
+        return 1;
+    }
+    printf("listening: %s\n", path);
+    printf("pool: %u\n", pool_size);
+    printf("preloaded: %zu\n", preload.size());
+    fflush(stdout);
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0)
+            continue;
+        std::thread(serve, fd).detach();
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <cstdint>
+
+//binary protocol of gbserver over a unix stream socket, little endian, no padding between messages
+//every request is a server_request followed by length payload bytes,
+//every reply is a server_reply followed by length payload bytes, one reply per request in order
+//
+//command        payload                                         reply payload
+//SERVER_CREATE  rom path                                        uint32 session
+//SERVER_CLOSE   -                                               -
+//SERVER_STEP    step_request, then up to frames input bytes     step_reply
+//SERVER_READ    read_request                                    length bytes read like the cpu
+//SERVER_FRAME   -                                               256x256 palette indexes of the last drawn frame
+//SERVER_LOAD    savestate.h image                               -
+//SERVER_SAVE    -                                               savestate.h image
+//SERVER_STATS   -                                               json object with the pool metrics
+
+#define SERVER_MAX_PAYLOAD (16 << 20)
+
+enum server_command {
+    SERVER_CREATE = 1,
+    SERVER_CLOSE,
+    SERVER_STEP,
+    SERVER_READ,
+    SERVER_FRAME,
+    SERVER_LOAD,
+    SERVER_SAVE,
+    SERVER_STATS
+};
+
+enum server_status {
+    SERVER_OK,
+    SERVER_BAD_REQUEST,
+    SERVER_NO_SESSION,
+    SERVER_POOL_EXHAUSTED,
+    SERVER_ROM_ERROR,
+    SERVER_UNSUPPORTED
+};
+
+typedef struct server_request {
+    uint32_t length;
+    uint8_t command;
+    uint8_t unused[3];
+    //ignored by SERVER_CREATE and SERVER_STATS
+    uint32_t session;
+} server_request;
+
+typedef struct server_reply {
+    uint32_t length;
+    uint8_t status;
+    uint8_t unused[3];
+} server_reply;
+
+//frames past the end of the inputs have no button pressed, a step of more than SERVER_MAX_STEP_FRAMES frames
+//is a bad request
+#define SERVER_MAX_STEP_FRAMES 600
+typedef struct step_request {
+    uint32_t frames;
+    uint8_t render;
+    uint8_t unused[3];
+} step_request;
+
+//totals of the session after the step
+typedef struct step_reply {
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t frames;
+    uint16_t pc;
+    uint8_t unused[6];
+} step_reply;
+
+typedef struct read_request {
+    uint16_t address;
+    uint16_t length;
+} read_request;
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <new>
+#include "shmring.h"
+
+#ifndef _WIN32
+
+static uint32_t align64(size_t size) {
+    return (uint32_t) ((size + 63) & ~(size_t) 63);
+}
+
+shm_ring *create_shm_ring(const char *name, uint32_t slots, const render_target *format,
+                          const shm_range *ranges, uint32_t range_count) {
+    if (slots == 0 || range_count > SHM_MAX_RANGES || strlen(name) >= 256) {
+        printf("invalid shared memory ring %s\n", name);
+        return NULL;
+    }
+    size_t row_bytes;
+    size_t frame_size = render_target_size(format, &row_bytes);
+    size_t ranges_size = 0;
+    for (uint32_t i = 0; i < range_count; i++)
+        ranges_size += ranges[i].length;
+    uint32_t slot_offset = align64(sizeof(shm_ring_header));
+    uint32_t frame_offset = align64(sizeof(shm_slot));
+    uint32_t ranges_offset = align64(frame_offset + frame_size);
+    uint32_t slot_size = align64(ranges_offset + ranges_size);
+    size_t size = slot_offset + (size_t) slot_size * slots;
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 || ftruncate(fd, size) != 0) {
+        printf("cannot create shared memory %s\n", name);
+        if (fd >= 0) {
+            close(fd);
+            shm_unlink(name);
+        }
+        return NULL;
+    }
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    shm_ring *ring = base != MAP_FAILED ? new (std::nothrow) shm_ring() : NULL;
+    if (ring == NULL) {
+        printf("cannot map shared memory %s\n", name);
+        if (base != MAP_FAILED)
+            munmap(base, size);
+        shm_unlink(name);
+        return NULL;
+    }
+    strcpy(ring->name, name);
+    ring->header = (shm_ring_header *) base;
+    ring->size = size;
+    ring->target = *format;
+    ring->target.stride = row_bytes;
+
+    //the object comes zeroed, so every slot starts at sequence 0 and published at 0
+    shm_ring_header *h = ring->header;
+    h->version = SHM_RING_VERSION;
+    h->slot_count = slots;
+    h->slot_offset = slot_offset;
+    h->slot_size = slot_size;
+    h->frame_offset = frame_offset;
+    int ds = format->downscale == 2 ? 2 : 1;
+    h->frame_row_bytes = row_bytes;
+    h->frame_height = row_bytes > 0 ? frame_size / row_bytes : 0;
+    h->frame_width = (format->width != 0 && format->width < 256 - format->x ? format->width : 256 - format->x) / ds;
+    h->frame_format = format->format;
+    h->ranges_offset = ranges_offset;
+    h->range_count = range_count;
+    memcpy(h->ranges, ranges, range_count * sizeof(shm_range));
+    //readers check the magic last
+    std::atomic_thread_fence(std::memory_order_release);
+    h->magic = SHM_RING_MAGIC;
+    return ring;
+}
+
+void destroy_shm_ring(shm_ring *ring) {
+    if (ring == NULL)
+        return;
+    munmap(ring->header, ring->size);
+    shm_unlink(ring->name);
+    delete ring;
+}
+
+void shm_ring_begin(shm_ring *ring, gameboy *gb) {
+    shm_ring_header *h = ring->header;
+    uint64_t frame = ring->frames;
+    ring->slot = (shm_slot *) ((uint8_t *) h + h->slot_offset + (frame % h->slot_count) * h->slot_size);
+    ring->slot->sequence.store(2 * frame + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    ring->target.pixels = (uint8_t *) ring->slot + h->frame_offset;
+    ring->saved_output = gb->output;
+    gb->output = &ring->target;
+}
+
+void shm_ring_publish(shm_ring *ring, gameboy *gb) {
+    shm_ring_header *h = ring->header;
+    shm_slot *slot = ring->slot;
+    uint64_t frame = ring->frames++;
+    gb->output = ring->saved_output;
+    slot->frame = frame;
+    slot->cycles = gb->total_cycles;
+    slot->instructions = gb->total_instructions;
+    slot->AF = gb->reg.AF;
+    slot->BC = gb->reg.BC;
+    slot->DE = gb->reg.DE;
+    slot->HL = gb->reg.HL;
+    slot->SP = gb->reg.SP;
+    slot->PC = gb->reg.PC;
+    slot->ime = gb->reg.ime;
+    uint8_t *out = (uint8_t *) slot + h->ranges_offset;
+    for (uint32_t i = 0; i < h->range_count; i++) {
+        for (uint32_t a = 0; a < h->ranges[i].length; a++)
+            out[a] = read_memory(gb, h->ranges[i].address + a);
+        out += h->ranges[i].length;
+    }
+    slot->sequence.store(2 * frame + 2, std::memory_order_release);
+    h->published.store(frame + 1, std::memory_order_release);
+}
+
+const shm_ring_header *open_shm_ring(const char *name, size_t *size) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+    off_t end = lseek(fd, 0, SEEK_END);
+    void *base = end >= (off_t) sizeof(shm_ring_header) ? mmap(NULL, end, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+    const shm_ring_header *h = (const shm_ring_header *) base;
+    if (h->magic != SHM_RING_MAGIC || h->version != SHM_RING_VERSION) {
+        munmap(base, end);
+        return NULL;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    *size = end;
+    return h;
+}
+
+void close_shm_ring(const shm_ring_header *header, size_t size) {
+    munmap((void *) header, size);
+}
+
+int shm_ring_read(const shm_ring_header *h, uint64_t frame, uint8_t *out) {
+    const shm_slot *slot = (const shm_slot *) ((const uint8_t *) h + h->slot_offset + (frame % h->slot_count) * h->slot_size);
+    uint64_t before = slot->sequence.load(std::memory_order_acquire);
+    if (before != 2 * frame + 2)
+        return -1;
+    memcpy(out, slot, h->slot_size);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot->sequence.load(std::memory_order_relaxed) == before ? 0 : -1;
+}
+
+#else
+
+shm_ring *create_shm_ring(const char *name, uint32_t slots, const render_target *format,
+                          const shm_range *ranges, uint32_t range_count) {
+    printf("shared memory export is not supported\n");
+    return NULL;
+}
+
+void destroy_shm_ring(shm_ring *ring) {
+}
+
+void shm_ring_begin(shm_ring *ring, gameboy *gb) {
+}
+
+void shm_ring_publish(shm_ring *ring, gameboy *gb) {
+}
+
+const shm_ring_header *open_shm_ring(const char *name, size_t *size) {
+    return NULL;
+}
+
+void close_shm_ring(const shm_ring_header *header, size_t size) {
+}
+
+int shm_ring_read(const shm_ring_header *header, uint64_t frame, uint8_t *out) {
+    return -1;
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <atomic>
+#include "gb.h"
+
+//posix shared memory ring of finished frames for other processes
+//the object starts with shm_ring_header, slot i is at slot_offset + i * slot_size:
+//a shm_slot, the frame at frame_offset and the memory ranges back to back at ranges_offset
+//frame n goes to slot n % slot_count and published is n + 1 once it is complete
+//every slot is a seqlock: sequence is odd while the slot is written and 2 * frame + 2 once it is done,
+//a reader copies the slot and keeps the copy if sequence was even and the same before and after,
+//so readers never make a syscall after mapping the object and never slow the emulator down
+
+#define SHM_RING_MAGIC 0x474E495242474Dull //"MGBRING" little endian
+#define SHM_RING_VERSION 1
+#define SHM_MAX_RANGES 16
+
+typedef struct shm_range {
+    uint16_t address;
+    uint16_t length;
+} shm_range;
+
+typedef struct shm_ring_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_offset;
+    uint32_t slot_size;
+    //frame inside a slot, pixel_format rows of frame_row_bytes
+    uint32_t frame_offset;
+    uint32_t frame_width;
+    uint32_t frame_height;
+    uint32_t frame_row_bytes;
+    uint32_t frame_format;
+    uint32_t ranges_offset;
+    uint32_t range_count;
+    shm_range ranges[SHM_MAX_RANGES];
+    //frames published so far
+    alignas(64) std::atomic<uint64_t> published;
+} shm_ring_header;
+
+typedef struct alignas(64) shm_slot {
+    std::atomic<uint64_t> sequence;
+    uint64_t frame;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint16_t AF, BC, DE, HL, SP, PC;
+    uint8_t ime;
+} shm_slot;
+
+typedef struct shm_ring {
+    char name[256];
+    shm_ring_header *header;
+    size_t size;
+    uint64_t frames;
+    //frame being written between begin and publish
+    shm_slot *slot;
+    render_target target;
+    const render_target *saved_output;
+} shm_ring;
+
+//writer, creates or replaces the object name, format gives the frame layout (its pixels and stride are ignored)
+//NULL on error or on systems without posix shared memory
+shm_ring *create_shm_ring(const char *name, uint32_t slots, const render_target *format,
+                          const shm_range *ranges, uint32_t range_count);
+//unmap and unlink
+void destroy_shm_ring(shm_ring *ring);
+//around end_frame: begin opens the next slot and draws the frame into it, publish fills in the registers
+//and the ranges and closes it
+void shm_ring_begin(shm_ring *ring, gameboy *gb);
+void shm_ring_publish(shm_ring *ring, gameboy *gb);
+
+//reader, maps name read only, NULL if it does not exist or is not a ring
+const shm_ring_header *open_shm_ring(const char *name, size_t *size);
+void close_shm_ring(const shm_ring_header *header, size_t size);
+//copy slot frame into out (slot_size bytes), 0 if the copy is consistent, -1 if the frame was overwritten
+int shm_ring_read(const shm_ring_header *header, uint64_t frame, uint8_t *out);
+
+#endif
@@ -0,0 +1,106 @@
+#include "statehash.h"
+#include "savestate.h"
+#include "hash.h"
+
+#define VRAM_BLOCK (VRAM >> HASH_BLOCK_SHIFT)
+#define VRAM_BLOCKS (0x2000 >> HASH_BLOCK_SHIFT)
+
+static inline const uint8_t *block_data(gameboy *gb, int n) {
+    return gb->mem[n >> (PAGE_SHIFT - HASH_BLOCK_SHIFT)] + ((n << HASH_BLOCK_SHIFT) & (PAGE_SIZE - 1));
+}
+
+//rehash the dirty blocks in [first, first + count), count a multiple of 16, the map is read 16 bytes at a time
+static void hash_dirty(gameboy *gb, int first, int count) {
+    for (int group = first; group < first + count; group += 16) {
+        __m128i flags = _mm_loadu_si128((const __m128i *) (gb->dirty + group));
+        uint32_t bits = _mm_movemask_epi8(_mm_cmpeq_epi8(flags, _mm_setzero_si128())) ^ 0xFFFF;
+        if (bits == 0)
+            continue;
+        _mm_storeu_si128((__m128i *) (gb->dirty + group), _mm_setzero_si128());
+        while (bits != 0) {
+            int n = group + __builtin_ctz(bits);
+            uint64_t h = hash_bytes(block_data(gb, n), HASH_BLOCK_SIZE, n);
+            gb->memory_hash += h - gb->block_hash[n];
+            gb->block_hash[n] = h;
+            bits &= bits - 1;
+        }
+    }
+}
+
+void hash_latched_vram(gameboy *gb) {
+    hash_dirty(gb, VRAM_BLOCK, VRAM_BLOCKS);
+    uint64_t h = 0;
+    for (int n = 0; n < VRAM_BLOCKS; n++)
+        h += gb->block_hash[VRAM_BLOCK + n];
+    gb->vram_hash = h;
+    gb->vram_hashed = 1;
+}
+
+uint64_t state_hash(gameboy *gb) {
+    if (!gb->hashing) {
+        memset(gb->block_hash, 0, sizeof(gb->block_hash));
+        memset(gb->dirty, 1, sizeof(gb->dirty));
+        gb->memory_hash = 0;
+        gb->hashing = 1;
+    }
+    hash_dirty(gb, 0, HASH_BLOCKS);
+    //after a load the latched vram has no block hashes, it is hashed like the blocks it was copied from
+    if (!gb->vram_hashed) {
+        uint64_t h = 0;
+        for (int n = 0; n < VRAM_BLOCKS; n++)
+            h += hash_bytes(gb->vram + n * HASH_BLOCK_SIZE, HASH_BLOCK_SIZE, VRAM_BLOCK + n);
+        gb->vram_hash = h;
+        gb->vram_hashed = 1;
+    }
+    //the rest is small and hashed whole
+    struct {
+        state_cpu cpu;
+        uint64_t memory_hash;
+        uint64_t vram_hash;
+        uint8_t ppu_registers[0xc];
+        uint8_t oam[0xA0];
+        uint8_t unused[4];
+    } rest;
+    save_cpu_state(gb, &rest.cpu);
+    rest.memory_hash = gb->memory_hash;
+    rest.vram_hash = gb->vram_hash;
+    memcpy(rest.ppu_registers, gb->ppu_registers, sizeof(rest.ppu_registers));
+    memcpy(rest.oam, gb->oam, sizeof(rest.oam));
+    memset(rest.unused, 0, sizeof(rest.unused));
+    return hash_bytes(&rest, sizeof(rest), HASH_BLOCKS);
+}
+
+int state_difference(gameboy *a, gameboy *b, char *where, size_t size) {
+    size_t n = state_size();
+    uint8_t *sa = (uint8_t *) malloc(n);
+    uint8_t *sb = (uint8_t *) malloc(n);
+    if (sa == NULL || sb == NULL) {
+        free(sa);
+        free(sb);
+        snprintf(where, size, "unknown, out of memory");
+        return -2;
+    }
+    int offset = -1;
+    save_state(a, sa);
+    save_state(b, sb);
+    for (size_t i = 0; i < n && offset < 0; i++)
+        if (sa[i] != sb[i])
+            offset = i;
+    snprintf(where, size, "-");
+    //the section table of the image says where the byte is
+    const state_header *h = (const state_header *) sa;
+    const state_section *table = (const state_section *) (sa + sizeof(state_header));
+    for (uint32_t i = 0; offset >= 0 && i < h->section_count; i++) {
+        if ((uint64_t) offset >= table[i].offset && (uint64_t) offset < table[i].offset + table[i].size) {
+            char tag[5];
+            memcpy(tag, &table[i].tag, 4);
+            tag[4] = 0;
+            if (tag[3] == ' ')
+                tag[3] = 0;
+            snprintf(where, size, "%s %04X", tag, (unsigned) (offset - table[i].offset));
+        }
+    }
+    free(sa);
+    free(sb);
+    return offset;
+}
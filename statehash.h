@@ -0,0 +1,20 @@
+#ifndef STATEHASH_H
+#define STATEHASH_H
+
+#include "gb.h"
+
+//64 bit hash of everything a savestate holds: registers and counters, bank, memory (wram, hram, io, vram, oam)
+//and the copies latched for the ppu, equal states give equal hashes
+//memory is hashed in 256 byte blocks seeded with their number and summed, write_memory marks the blocks it
+//touches so a hash only rehashes the blocks written since the last one, the first hash of an instance and the
+//first after a state load or a power on go over every block
+
+//hash of gb, keeps the block hashes of gb up to date
+uint64_t state_hash(gameboy *gb);
+//called by latch_ppu while gb is hashed, the latched vram is a copy of the vram blocks so its hash is theirs
+void hash_latched_vram(gameboy *gb);
+//first difference between the states of a and b as "section offset" in where, -1 if they are the same,
+//-2 if they could not be compared for lack of memory
+int state_difference(gameboy *a, gameboy *b, char *where, size_t size);
+
+#endif
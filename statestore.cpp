@@ -0,0 +1,220 @@
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <new>
+#include "statestore.h"
+#include "savestate.h"
+#include "hash.h"
+
+static uint8_t *map_pages(size_t size, const char *backing) {
+#ifndef _WIN32
+    if (backing == NULL) {
+        void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        return p != MAP_FAILED ? (uint8_t *) p : NULL;
+    }
+    //sparse, the file only takes the blocks of the pages written
+    int fd = open(backing, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, size) != 0) {
+        printf("cannot create store file %s\n", backing);
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return p != MAP_FAILED ? (uint8_t *) p : NULL;
+#else
+    if (backing != NULL)
+        printf("store files are not supported, using memory\n");
+    return (uint8_t *) malloc(size);
+#endif
+}
+
+static void unmap_pages(uint8_t *data, size_t size) {
+#ifndef _WIN32
+    munmap(data, size);
+#else
+    free(data);
+#endif
+}
+
+page_store *create_page_store(uint32_t max_pages, const char *backing) {
+    if (max_pages == 0 || max_pages > 0x40000000)
+        return NULL;
+    page_store *s = new (std::nothrow) page_store();
+    if (s == NULL)
+        return NULL;
+    s->max_pages = max_pages;
+    s->data_size = (size_t) max_pages * STORE_PAGE;
+    s->data = map_pages(s->data_size, backing);
+    s->pages = (store_page *) calloc(max_pages, sizeof(store_page));
+    //at most half full
+    uint32_t index_size = 1;
+    while (index_size < 2 * max_pages)
+        index_size <<= 1;
+    s->index = (uint32_t *) calloc(index_size, sizeof(uint32_t));
+    s->index_mask = index_size - 1;
+    s->snapshot_pages = (state_size() + STORE_PAGE - 1) / STORE_PAGE;
+    s->state = (uint8_t *) malloc(state_size());
+    //the padding stays zero
+    s->last = (uint8_t *) calloc(1, STORE_PAGE);
+    if (s->data == NULL || s->pages == NULL || s->index == NULL || s->state == NULL || s->last == NULL) {
+        destroy_page_store(s);
+        return NULL;
+    }
+    s->free_page = UINT32_MAX;
+    return s;
+}
+
+void destroy_page_store(page_store *s) {
+    if (s == NULL)
+        return;
+    if (s->data != NULL)
+        unmap_pages(s->data, s->data_size);
+    free(s->pages);
+    free(s->index);
+    free(s->snapshots);
+    free(s->free_ids);
+    free(s->state);
+    free(s->last);
+    delete s;
+}
+
+//slot holding page, a new one with no reference if it is not stored yet, UINT32_MAX if the store is full
+static uint32_t find_page(page_store *s, const uint8_t *page) {
+    uint64_t hash = hash_bytes(page, STORE_PAGE, 0);
+    uint32_t i = (uint32_t) hash & s->index_mask;
+    for (; s->index[i] != 0; i = (i + 1) & s->index_mask) {
+        uint32_t slot = s->index[i] - 1;
+        if (s->pages[slot].hash == hash && memcmp(s->data + (size_t) slot * STORE_PAGE, page, STORE_PAGE) == 0)
+            return slot;
+    }
+    uint32_t slot;
+    if (s->free_page != UINT32_MAX) {
+        slot = s->free_page;
+        s->free_page = s->pages[slot].next;
+    } else if (s->fresh < s->max_pages)
+        slot = s->fresh++;
+    else
+        return UINT32_MAX;
+    memcpy(s->data + (size_t) slot * STORE_PAGE, page, STORE_PAGE);
+    s->pages[slot] = {hash, 0, 0};
+    s->index[i] = slot + 1;
+    s->live_pages++;
+    return slot;
+}
+
+//drop a reference, the last one frees the slot and takes it out of the index
+static void unref_page(page_store *s, uint32_t slot) {
+    if (--s->pages[slot].refs > 0)
+        return;
+    uint32_t i = (uint32_t) s->pages[slot].hash & s->index_mask;
+    while (s->index[i] != slot + 1)
+        i = (i + 1) & s->index_mask;
+    //backward shift, the entries after the hole that can move into it do
+    for (uint32_t j = (i + 1) & s->index_mask; s->index[j] != 0; j = (j + 1) & s->index_mask) {
+        uint32_t home = (uint32_t) s->pages[s->index[j] - 1].hash & s->index_mask;
+        if (((j - home) & s->index_mask) >= ((j - i) & s->index_mask)) {
+            s->index[i] = s->index[j];
+            i = j;
+        }
+    }
+    s->index[i] = 0;
+    s->pages[slot].next = s->free_page;
+    s->free_page = slot;
+    s->live_pages--;
+}
+
+static int grow_snapshots(page_store *s) {
+    uint32_t capacity = s->snapshot_capacity > 0 ? s->snapshot_capacity * 2 : 1024;
+    uint32_t *snapshots = (uint32_t *) realloc(s->snapshots, (size_t) capacity * s->snapshot_pages * sizeof(uint32_t));
+    if (snapshots == NULL)
+        return -1;
+    s->snapshots = snapshots;
+    uint32_t *free_ids = (uint32_t *) realloc(s->free_ids, (size_t) capacity * sizeof(uint32_t));
+    if (free_ids == NULL)
+        return -1;
+    s->free_ids = free_ids;
+    s->snapshot_capacity = capacity;
+    return 0;
+}
+
+int store_put(page_store *s, const uint8_t *state) {
+    uint32_t id;
+    if (s->free_id_count > 0)
+        id = s->free_ids[--s->free_id_count];
+    else if (s->snapshot_count < s->snapshot_capacity || grow_snapshots(s) == 0)
+        id = s->snapshot_count++;
+    else
+        return -1;
+    uint32_t *list = s->snapshots + (size_t) id * s->snapshot_pages;
+    size_t size = state_size();
+    for (uint32_t n = 0; n < s->snapshot_pages; n++) {
+        const uint8_t *page = state + (size_t) n * STORE_PAGE;
+        //the last page is partial
+        if ((size_t) (n + 1) * STORE_PAGE > size) {
+            memcpy(s->last, page, size - (size_t) n * STORE_PAGE);
+            page = s->last;
+        }
+        uint32_t slot = find_page(s, page);
+        if (slot == UINT32_MAX) {
+            for (uint32_t k = 0; k < n; k++)
+                unref_page(s, list[k] - 1);
+            list[0] = 0;
+            s->free_ids[s->free_id_count++] = id;
+            return -1;
+        }
+        s->pages[slot].refs++;
+        list[n] = slot + 1;
+    }
+    s->live_snapshots++;
+    return (int) id;
+}
+
+int store_save(page_store *s, gameboy *gb) {
+    save_state(gb, s->state);
+    return store_put(s, s->state);
+}
+
+static const uint32_t *snapshot(const page_store *s, uint32_t id) {
+    if (id >= s->snapshot_count || s->snapshots[(size_t) id * s->snapshot_pages] == 0)
+        return NULL;
+    return s->snapshots + (size_t) id * s->snapshot_pages;
+}
+
+int store_get(page_store *s, uint32_t id, uint8_t *out) {
+    const uint32_t *list = snapshot(s, id);
+    if (list == NULL)
+        return -1;
+    size_t size = state_size();
+    for (uint32_t n = 0; n < s->snapshot_pages; n++) {
+        size_t offset = (size_t) n * STORE_PAGE;
+        size_t length = offset + STORE_PAGE <= size ? STORE_PAGE : size - offset;
+        memcpy(out + offset, s->data + (size_t) (list[n] - 1) * STORE_PAGE, length);
+    }
+    return 0;
+}
+
+int store_load(page_store *s, uint32_t id, gameboy *gb) {
+    if (store_get(s, id, s->state))
+        return -1;
+    return load_state(gb, s->state, state_size());
+}
+
+void store_release(page_store *s, uint32_t id) {
+    uint32_t *list = (uint32_t *) snapshot(s, id);
+    if (list == NULL)
+        return;
+    for (uint32_t n = 0; n < s->snapshot_pages; n++)
+        unref_page(s, list[n] - 1);
+    list[0] = 0;
+    s->free_ids[s->free_id_count++] = id;
+    s->live_snapshots--;
+}
+
+size_t store_bytes(const page_store *s) {
+    return (size_t) s->live_pages * STORE_PAGE + (size_t) (s->index_mask + 1) * sizeof(uint32_t) +
+           (size_t) s->snapshot_count * s->snapshot_pages * sizeof(uint32_t);
+}
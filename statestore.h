@@ -0,0 +1,66 @@
+#ifndef STATESTORE_H
+#define STATESTORE_H
+
+#include "gb.h"
+
+//content addressed store of savestates
+//a state is cut in STORE_PAGE byte pages, the last one padded with zeros, and every distinct page is kept once
+//with a reference count, a snapshot is only its list of page slots, so memory grows with the distinct content
+//pages are found by their hash (hash.h) through a linear probing index and compared in full before sharing
+//the page data is one mapping of max_pages pages: anonymous memory, or a sparse backing file the kernel can
+//write cold pages back to, only the pages in use are ever touched
+//not thread safe, one store per thread or a lock around it
+
+#define STORE_PAGE 4096
+
+typedef struct store_page {
+    uint64_t hash;
+    //0 when the slot is free
+    uint32_t refs;
+    //next free slot
+    uint32_t next;
+} store_page;
+
+typedef struct page_store {
+    uint8_t *data;
+    size_t data_size;
+    store_page *pages;
+    uint32_t max_pages;
+    //never used slots start here, released ones go in the free list
+    uint32_t fresh;
+    uint32_t free_page;
+    uint32_t live_pages;
+    //slot + 1 of every page, 0 is empty
+    uint32_t *index;
+    uint32_t index_mask;
+    //pages per snapshot, page slot + 1 of every snapshot back to back, 0 for a released snapshot
+    uint32_t snapshot_pages;
+    uint32_t *snapshots;
+    uint32_t snapshot_capacity;
+    uint32_t snapshot_count;
+    uint32_t live_snapshots;
+    //ids of released snapshots, reused first
+    uint32_t *free_ids;
+    uint32_t free_id_count;
+    //a state is assembled here
+    uint8_t *state;
+    //the last page of a state is padded here
+    uint8_t *last;
+} page_store;
+
+//room for max_pages distinct pages, backing NULL for anonymous memory, NULL on error
+page_store *create_page_store(uint32_t max_pages, const char *backing);
+void destroy_page_store(page_store *s);
+//keep a state_size() byte state, returns its snapshot id or -1 if the store is full
+int store_put(page_store *s, const uint8_t *state);
+//save gb and keep it
+int store_save(page_store *s, gameboy *gb);
+//copy a snapshot out to state_size() bytes, -1 if there is no such snapshot
+int store_get(page_store *s, uint32_t id, uint8_t *out);
+//load a snapshot into gb, -1 if there is no such snapshot or it is from another rom
+int store_load(page_store *s, uint32_t id, gameboy *gb);
+void store_release(page_store *s, uint32_t id);
+//bytes in use: the distinct pages, the index and the snapshot lists
+size_t store_bytes(const page_store *s);
+
+#endif
@@ -0,0 +1,269 @@
+#include <new>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include "gb.h"
+#include "gbemu.h"
+
+int output_to_target(const gbemu_output *output, render_target *t);
+gameboy *create_reset_state(const rom *r, const uint8_t *data, size_t size);
+
+//vector env of the c abi, every step is split over a pool of persistent workers
+//lanes are claimed one at a time from a shared counter, a frame is long enough that the counter is not contended
+
+typedef struct vec_lane {
+    gameboy *gb;
+    uint32_t episode_frames;
+    //episodes started, picks the reset state
+    uint64_t episodes;
+    uint8_t done;
+} vec_lane;
+
+struct gbemu_vec {
+    gbemu_vec_config config;
+    rom cart;
+    size_t observation_size;
+    //frame part of the observations, pixels is set per lane
+    render_target frame;
+    size_t frame_size;
+    uint32_t frame_skip;
+    std::vector<vec_lane> lanes;
+    //frozen instances episodes start from, power on when empty
+    std::vector<gameboy *> reset_states;
+
+    //pool, the calling thread works too so threads - 1 are started
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable start;
+    std::condition_variable finished;
+    uint64_t generation;
+    uint32_t busy;
+    int stop;
+    alignas(64) std::atomic<uint32_t> next_lane;
+
+    //arguments of the running call
+    int resetting;
+    const uint8_t *inputs;
+    uint8_t *observations;
+    uint8_t *dones;
+};
+
+//copy len bytes from address through the page table, so the selected rom bank reads like the cpu sees it
+static void copy_range(gameboy *gb, uint16_t address, uint32_t len, uint8_t *out) {
+    uint32_t a = address;
+    while (len > 0) {
+        uint32_t offset = a & (PAGE_SIZE - 1);
+        uint32_t n = PAGE_SIZE - offset < len ? PAGE_SIZE - offset : len;
+        memcpy(out, gb->page[a >> PAGE_SHIFT] + offset, n);
+        out += n;
+        a += n;
+        len -= n;
+    }
+}
+
+//the ram part of an observation, the frame in front of it is drawn by render
+static void observe(gbemu_vec *vec, gameboy *gb, uint8_t *out) {
+    out += vec->frame_size;
+    for (uint32_t i = 0; i < vec->config.range_count; i++) {
+        copy_range(gb, vec->config.ranges[i].address, vec->config.ranges[i].length, out);
+        out += vec->config.ranges[i].length;
+    }
+}
+
+static void power_on(gbemu_vec *vec, vec_lane *lane) {
+    if (vec->reset_states.empty())
+        machine_init(lane->gb, &vec->cart);
+    else
+        reset_gameboy(vec->reset_states[(lane - vec->lanes.data() + lane->episodes) % vec->reset_states.size()],
+                      lane->gb);
+    lane->episodes++;
+    lane->episode_frames = 0;
+    lane->done = 0;
+}
+
+static void step_lane(gbemu_vec *vec, uint32_t i) {
+    vec_lane *lane = &vec->lanes[i];
+    gameboy *gb = lane->gb;
+    uint8_t *observation = vec->observations != NULL ? vec->observations + i * vec->observation_size : NULL;
+    //the frame is drawn straight into the observation, lanes only differ in where it goes
+    render_target frame = vec->frame;
+    frame.pixels = observation;
+    gb->output = &frame;
+    int draw = vec->config.observe_frame && observation != NULL;
+    if (vec->resetting || lane->done) {
+        power_on(vec, lane);
+        if (vec->resetting) {
+            //the power on observation has a drawn frame too
+            if (draw)
+                render(gb);
+            if (observation != NULL)
+                observe(vec, gb, observation);
+            gb->output = NULL;
+            return;
+        }
+    }
+    set_joypad(gb, vec->inputs[i]);
+    for (uint32_t f = 0; f < vec->frame_skip; f++)
+        run_frame(gb, draw && f + 1 == vec->frame_skip);
+    lane->episode_frames += vec->frame_skip;
+    const gbemu_vec_config *c = &vec->config;
+    lane->done = (c->max_frames != 0 && lane->episode_frames >= c->max_frames) ||
+                 (c->done_mask != 0 && (read_memory(gb, c->done_address) & c->done_mask) == c->done_value);
+    if (observation != NULL)
+        observe(vec, gb, observation);
+    if (vec->dones != NULL)
+        vec->dones[i] = lane->done;
+    gb->output = NULL;
+}
+
+static void work(gbemu_vec *vec) {
+    uint32_t count = (uint32_t) vec->lanes.size();
+    for (uint32_t i = vec->next_lane.fetch_add(1); i < count; i = vec->next_lane.fetch_add(1))
+        step_lane(vec, i);
+}
+
+static void worker(gbemu_vec *vec) {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(vec->lock);
+            vec->start.wait(guard, [&] { return vec->stop || vec->generation != seen; });
+            if (vec->stop)
+                return;
+            seen = vec->generation;
+        }
+        work(vec);
+        std::lock_guard<std::mutex> guard(vec->lock);
+        if (--vec->busy == 0)
+            vec->finished.notify_one();
+    }
+}
+
+//run step_lane on every lane and wait for all of them
+static void run(gbemu_vec *vec) {
+    vec->next_lane.store(0);
+    if (vec->workers.empty()) {
+        work(vec);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(vec->lock);
+        vec->busy = (uint32_t) vec->workers.size();
+        vec->generation++;
+    }
+    vec->start.notify_all();
+    work(vec);
+    std::unique_lock<std::mutex> guard(vec->lock);
+    vec->finished.wait(guard, [&] { return vec->busy == 0; });
+}
+
+static gbemu_vec *create(gbemu_vec *vec, const gbemu_vec_config *config) {
+    vec->config = *config;
+    vec->frame_skip = config->frame_skip > 0 ? config->frame_skip : 1;
+    int valid = config->count > 0 && config->range_count <= GBEMU_MAX_RANGES;
+    if (config->observe_frame)
+        valid = valid && output_to_target(&config->frame, &vec->frame) == 0;
+    vec->frame.stride = 0;
+    vec->frame_size = config->observe_frame && valid ? render_target_size(&vec->frame, NULL) : 0;
+    vec->observation_size = vec->frame_size;
+    for (uint32_t i = 0; valid && i < config->range_count; i++) {
+        valid = config->ranges[i].address + config->ranges[i].length <= 0x10000;
+        vec->observation_size += config->ranges[i].length;
+    }
+    //the c abi reports errors through the return value only
+    if (!valid) {
+        gbemu_vec_destroy(vec);
+        return NULL;
+    }
+    vec->lanes.resize(config->count);
+    for (vec_lane &lane : vec->lanes) {
+        if ((lane.gb = create_gameboy()) == NULL) {
+            gbemu_vec_destroy(vec);
+            return NULL;
+        }
+        lane.gb->verbose = 0;
+        power_on(vec, &lane);
+    }
+    uint32_t threads = config->threads > 0 ? config->threads : std::thread::hardware_concurrency();
+    if (threads > config->count)
+        threads = config->count;
+    for (uint32_t i = 1; i < threads; i++)
+        vec->workers.emplace_back(worker, vec);
+    return vec;
+}
+
+gbemu_vec *gbemu_vec_create(const uint8_t *rom, size_t size, const gbemu_vec_config *config) {
+    gbemu_vec *vec = new (std::nothrow) gbemu_vec();
+    if (vec == NULL)
+        return NULL;
+    if (load_rom_buffer(&vec->cart, rom, size)) {
+        delete vec;
+        return NULL;
+    }
+    return create(vec, config);
+}
+
+gbemu_vec *gbemu_vec_create_file(const char *path, const gbemu_vec_config *config) {
+    gbemu_vec *vec = new (std::nothrow) gbemu_vec();
+    if (vec == NULL)
+        return NULL;
+    if (load_rom_file(&vec->cart, path)) {
+        delete vec;
+        return NULL;
+    }
+    return create(vec, config);
+}
+
+void gbemu_vec_destroy(gbemu_vec *vec) {
+    if (vec == NULL)
+        return;
+    {
+        std::lock_guard<std::mutex> guard(vec->lock);
+        vec->stop = 1;
+    }
+    vec->start.notify_all();
+    for (std::thread &t : vec->workers)
+        t.join();
+    for (vec_lane &lane : vec->lanes)
+        destroy_gameboy(lane.gb);
+    gbemu_vec_clear_reset_states(vec);
+    free_rom(&vec->cart);
+    delete vec;
+}
+
+size_t gbemu_vec_observation_size(const gbemu_vec *vec) {
+    return vec->observation_size;
+}
+
+void gbemu_vec_reset(gbemu_vec *vec, uint8_t *observations) {
+    vec->resetting = 1;
+    vec->inputs = NULL;
+    vec->observations = observations;
+    vec->dones = NULL;
+    run(vec);
+}
+
+void gbemu_vec_step(gbemu_vec *vec, const uint8_t *inputs, uint8_t *observations, uint8_t *dones) {
+    vec->resetting = 0;
+    vec->inputs = inputs;
+    vec->observations = observations;
+    vec->dones = dones;
+    run(vec);
+}
+
+int gbemu_vec_add_reset_state(gbemu_vec *vec, const uint8_t *data, size_t size) {
+    gameboy *state = create_reset_state(&vec->cart, data, size);
+    if (state == NULL)
+        return -1;
+    vec->reset_states.push_back(state);
+    return (int) vec->reset_states.size();
+}
+
+void gbemu_vec_clear_reset_states(gbemu_vec *vec) {
+    //the lanes keep their references to the pages until they are reset or written
+    for (gameboy *state : vec->reset_states)
+        destroy_gameboy(state);
+    vec->reset_states.clear();
+}